@@ -0,0 +1,68 @@
+#include <stdlib.h>
+#include "arena.h"
+
+struct ArenaBlock {
+    ArenaBlock *prev;
+    char *end;
+    char data[];
+};
+
+void arena_init(Arena *arena, size_t block_size) {
+    arena->head = NULL;
+    arena->ptr = NULL;
+    arena->end = NULL;
+    arena->block_size = block_size;
+    arena->block_count = 0;
+}
+
+// Start a new block with room for at least size bytes
+static int push_block(Arena *arena, size_t size) {
+    size_t capacity = size > arena->block_size ? size : arena->block_size;
+    ArenaBlock *block = (ArenaBlock *)malloc(sizeof(ArenaBlock) + capacity);
+    if (block == NULL) {
+        return 0;
+    }
+    block->prev = arena->head;
+    block->end = block->data + capacity;
+    arena->head = block;
+    arena->ptr = block->data;
+    arena->end = block->end;
+    arena->block_count++;
+    return 1;
+}
+
+char *arena_alloc(Arena *arena, size_t size) {
+    if ((size_t)(arena->end - arena->ptr) < size || arena->head == NULL) {
+        if (!push_block(arena, size)) {
+            return NULL;
+        }
+    }
+    char *result = arena->ptr;
+    arena->ptr += size;
+    return result;
+}
+
+void arena_reset(Arena *arena) {
+    if (arena->head == NULL) return;
+    
+    // Keep the oldest block for reuse
+    while (arena->head->prev != NULL) {
+        ArenaBlock *prev = arena->head->prev;
+        free(arena->head);
+        arena->head = prev;
+        arena->block_count--;
+    }
+    arena->ptr = arena->head->data;
+    arena->end = arena->head->end;
+}
+
+void arena_free(Arena *arena) {
+    while (arena->head != NULL) {
+        ArenaBlock *prev = arena->head->prev;
+        free(arena->head);
+        arena->head = prev;
+    }
+    arena->ptr = NULL;
+    arena->end = NULL;
+    arena->block_count = 0;
+}
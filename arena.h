@@ -0,0 +1,31 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/* Bump allocator for byte strings. Memory comes from large blocks and is
+   released all at once with arena_free (or reused after arena_reset). */
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct {
+    ArenaBlock *head;       /* newest block */
+    char *ptr;              /* next free byte in head */
+    char *end;              /* end of head */
+    size_t block_size;
+    size_t block_count;     /* blocks currently held */
+} Arena;
+
+/* Initializes an empty arena that allocates blocks of block_size bytes. */
+void arena_init(Arena *arena, size_t block_size);
+
+/* Returns size bytes (no alignment guarantee), or NULL on allocation
+   failure. Requests larger than the block size get a block of their own. */
+char *arena_alloc(Arena *arena, size_t size);
+
+/* Frees every allocation but keeps one block for reuse. */
+void arena_reset(Arena *arena);
+
+/* Releases all the memory of the arena. */
+void arena_free(Arena *arena);
+
+#endif // ARENA_H
@@ -0,0 +1,477 @@
+// Throughput benchmarks for the ex1 building blocks.
+// Build: gcc -O2 -o bench bench.c cleaner.c strip.c label_scan.c fp_set.c arena.c record_writer.c corpus_gen.c -pthread
+// Usage: bench [strip|dedup|write|pipeline [records]]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "strip.h"
+#include "fingerprint.h"
+#include "fp_set.h"
+#include "entry.h"
+#include "record_writer.h"
+#include "cleaner.h"
+#include "corpus_gen.h"
+
+#define STRIP_BENCH_SIZE (64 * 1024 * 1024)
+#define STRIP_BENCH_ROUNDS 5
+#define DEDUP_LINEAR_LIMIT 100000
+#define WRITE_BENCH_RECORDS 2000000
+#define WRITE_CHECK_RECORDS 10000
+#define PIPELINE_RECORDS 1000000
+#define PIPELINE_ROUNDS 3
+
+#ifdef _WIN32
+#define NULL_DEVICE "NUL"
+#else
+#define NULL_DEVICE "/dev/null"
+#endif
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Fill buf with record-like text where about percent% of the bytes are corruption
+static void fill_corrupted(char *buf, size_t n, int percent, unsigned seed) {
+    static const char text[] = "First Name: John\nSecond Name: Doe\nFingerprint: ABC123456\nPosition: Boss\n\n";
+    static const char corruption[] = "#?!@&$";
+    srand(seed);
+    size_t t = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (rand() % 100 < percent) {
+            buf[i] = corruption[rand() % 6];
+        } else {
+            buf[i] = text[t];
+            t = (t + 1) % (sizeof(text) - 1);
+        }
+    }
+}
+
+// Time one kernel, returns the best MB/s over a few rounds
+static double time_strip(size_t (*kernel)(const char *, size_t, char *),
+                         const char *src, size_t n, char *dst, size_t *out_len) {
+    double best = 0;
+    for (int r = 0; r < STRIP_BENCH_ROUNDS; r++) {
+        double start = now_seconds();
+        *out_len = kernel(src, n, dst);
+        double elapsed = now_seconds() - start;
+        double mbps = n / elapsed / 1e6;
+        if (mbps > best) best = mbps;
+    }
+    return best;
+}
+
+// Small deterministic generator, so every platform benchmarks the same data
+static uint64_t bench_rng_state = 88172645463325252ULL;
+
+static uint64_t bench_rand(void) {
+    bench_rng_state ^= bench_rng_state << 13;
+    bench_rng_state ^= bench_rng_state >> 7;
+    bench_rng_state ^= bench_rng_state << 17;
+    return bench_rng_state;
+}
+
+static int bench_strip(void) {
+    static const int densities[] = {0, 1, 10, 50};
+    char *src = (char *)malloc(STRIP_BENCH_SIZE);
+    char *expected = (char *)malloc(STRIP_BENCH_SIZE);
+    char *dst = (char *)malloc(STRIP_BENCH_SIZE);
+    if (src == NULL || expected == NULL || dst == NULL) {
+        printf("Memory allocation failed\n");
+        free(src);
+        free(expected);
+        free(dst);
+        return 1;
+    }
+    
+    strip_init();
+    printf("strip: selected kernel %s, %d MiB input\n", strip_kernel_name(), STRIP_BENCH_SIZE >> 20);
+    int failed = 0;
+    
+    for (size_t d = 0; d < sizeof(densities) / sizeof(densities[0]); d++) {
+        fill_corrupted(src, STRIP_BENCH_SIZE, densities[d], 1234);
+        
+        size_t expected_len, len;
+        double scalar = time_strip(strip_corruption_scalar, src, STRIP_BENCH_SIZE, expected, &expected_len);
+        printf("  %2d%% corruption  scalar %8.1f MB/s", densities[d], scalar);
+        
+        if (strip_have_sse42()) {
+            double mbps = time_strip(strip_corruption_sse42, src, STRIP_BENCH_SIZE, dst, &len);
+            printf("  sse4.2 %8.1f MB/s", mbps);
+            if (len != expected_len || memcmp(dst, expected, len) != 0) {
+                printf(" (MISMATCH)");
+                failed = 1;
+            }
+        }
+        if (strip_have_avx2()) {
+            double mbps = time_strip(strip_corruption_avx2, src, STRIP_BENCH_SIZE, dst, &len);
+            printf("  avx2 %8.1f MB/s", mbps);
+            if (len != expected_len || memcmp(dst, expected, len) != 0) {
+                printf(" (MISMATCH)");
+                failed = 1;
+            }
+        }
+        printf("\n");
+    }
+    
+    free(src);
+    free(expected);
+    free(dst);
+    return failed;
+}
+
+// Fill fps with n fingerprints, about 10% of them repeating an earlier one
+static void fill_fingerprints(char (*fps)[FINGERPRINT_LEN + 1], size_t n) {
+    static const char alnum[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+    for (size_t i = 0; i < n; i++) {
+        if (i > 0 && bench_rand() % 10 == 0) {
+            memcpy(fps[i], fps[bench_rand() % i], FINGERPRINT_LEN + 1);
+            continue;
+        }
+        for (int k = 0; k < FINGERPRINT_LEN; k++) {
+            fps[i][k] = alnum[bench_rand() % 62];
+        }
+        fps[i][FINGERPRINT_LEN] = '\0';
+    }
+}
+
+// Dedup cost per record: hash set against the old linear strcmp scan
+static int bench_dedup(void) {
+    static const size_t sizes[] = {1000, 10000, 100000, 1000000, 10000000};
+    int failed = 0;
+    printf("dedup: ns per record (first occurrence wins)\n");
+    
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t n = sizes[s];
+        char (*fps)[FINGERPRINT_LEN + 1] = malloc(n * sizeof(*fps));
+        if (fps == NULL) {
+            printf("Memory allocation failed\n");
+            return 1;
+        }
+        fill_fingerprints(fps, n);
+        
+        FpSet set;
+        if (!fp_set_init(&set, 16)) {
+            printf("Memory allocation failed\n");
+            free(fps);
+            return 1;
+        }
+        double start = now_seconds();
+        size_t unique = 0;
+        for (size_t i = 0; i < n; i++) {
+            unique += fp_set_insert(&set, pack_fingerprint(fps[i])) == 1;
+        }
+        double hashed = (now_seconds() - start) * 1e9 / n;
+        fp_set_free(&set);
+        printf("  %9zu records  %9zu unique  hash set %8.1f ns", n, unique, hashed);
+        
+        if (n <= DEDUP_LINEAR_LIMIT) {
+            // The accepted fingerprints sit at the front of fps, like entries did
+            char (*accepted)[FINGERPRINT_LEN + 1] = malloc(n * sizeof(*accepted));
+            if (accepted == NULL) {
+                printf("\nMemory allocation failed\n");
+                free(fps);
+                return 1;
+            }
+            size_t count = 0;
+            start = now_seconds();
+            for (size_t i = 0; i < n; i++) {
+                size_t j = 0;
+                while (j < count && strcmp(accepted[j], fps[i]) != 0) j++;
+                if (j == count) memcpy(accepted[count++], fps[i], FINGERPRINT_LEN + 1);
+            }
+            double linear = (now_seconds() - start) * 1e9 / n;
+            printf("  linear scan %10.1f ns", linear);
+            if (count != unique) {
+                printf(" (MISMATCH)");
+                failed = 1;
+            }
+            free(accepted);
+        }
+        printf("\n");
+        free(fps);
+    }
+    return failed;
+}
+
+// The per-field stdio writer ex1 used before record_writer, as a reference
+static void write_value_stdio(FILE *fp, const char *value, size_t len) {
+    size_t start = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (value[i] == '\n' || value[i] == '\r') {
+            fwrite(value + start, 1, i - start, fp);
+            start = i + 1;
+        }
+    }
+    fwrite(value + start, 1, len - start, fp);
+}
+
+static void write_records_stdio(FILE *fp, const Entry *entries, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const Entry *entry = &entries[i];
+        char fingerprint[FINGERPRINT_LEN + 1];
+        unpack_fingerprint(entry->fingerprint, fingerprint);
+        
+        fputs("First Name: ", fp);
+        write_value_stdio(fp, entry->text, entry->first_len);
+        fputs("\nSecond Name: ", fp);
+        write_value_stdio(fp, entry->text + entry->second_offset, entry->second_len);
+        fprintf(fp, "\nFingerprint: %s\nPosition: ", fingerprint);
+        const char *position = position_name((PositionType)entry->pos_type);
+        if (position != NULL) {
+            fputs(position, fp);
+        } else {
+            write_value_stdio(fp, entry->text + entry->position_offset, entry->position_len);
+        }
+        fputs("\n\n", fp);
+    }
+}
+
+// Fill entries with views into text, one in six of them an unknown position
+static void fill_entries(Entry *entries, size_t n, const char *text) {
+    static const char alnum[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+    for (size_t i = 0; i < n; i++) {
+        char fingerprint[FINGERPRINT_LEN];
+        for (int k = 0; k < FINGERPRINT_LEN; k++) {
+            fingerprint[k] = alnum[bench_rand() % 62];
+        }
+        Entry *entry = &entries[i];
+        entry->text = text;
+        entry->first_len = 4 + bench_rand() % 6;        // "Alexandra"
+        entry->second_offset = 10;
+        entry->second_len = 4 + bench_rand() % 5;       // "Hami\nlton" spans a newline
+        entry->position_offset = 20;
+        entry->position_len = 10;
+        entry->fingerprint = pack_fingerprint(fingerprint);
+        entry->original_order = i;
+        entry->pos_type = (uint8_t)(bench_rand() % POSITION_TYPE_COUNT);
+    }
+}
+
+// Compare two files byte by byte
+static int same_contents(FILE *a, FILE *b) {
+    char buf_a[4096], buf_b[4096];
+    rewind(a);
+    rewind(b);
+    for (;;) {
+        size_t n = fread(buf_a, 1, sizeof(buf_a), a);
+        if (fread(buf_b, 1, sizeof(buf_b), b) != n || memcmp(buf_a, buf_b, n) != 0) {
+            return 0;
+        }
+        if (n == 0) {
+            return 1;
+        }
+    }
+}
+
+// Records per second for the output stage alone
+static int bench_write(void) {
+    static const char text[] = "Alexandra Hami\nlton Accountant";
+    Entry *entries = (Entry *)malloc(WRITE_BENCH_RECORDS * sizeof(Entry));
+    if (entries == NULL) {
+        printf("Memory allocation failed\n");
+        return 1;
+    }
+    fill_entries(entries, WRITE_BENCH_RECORDS, text);
+    int failed = 0;
+    
+    // Both writers must produce the same bytes
+    FILE *expected = tmpfile();
+    FILE *actual = tmpfile();
+    if (expected == NULL || actual == NULL) {
+        printf("Error opening temporary file\n");
+        failed = 1;
+    } else {
+        write_records_stdio(expected, entries, WRITE_CHECK_RECORDS);
+        if (!write_records(actual, entries, WRITE_CHECK_RECORDS) || !same_contents(expected, actual)) {
+            printf("write: MISMATCH against the stdio writer\n");
+            failed = 1;
+        }
+    }
+    if (expected != NULL) fclose(expected);
+    if (actual != NULL) fclose(actual);
+    
+    FILE *sink = fopen(NULL_DEVICE, "wb");
+    if (sink == NULL) {
+        printf("Error opening file: %s\n", NULL_DEVICE);
+        free(entries);
+        return 1;
+    }
+    printf("write: %d records to %s\n", WRITE_BENCH_RECORDS, NULL_DEVICE);
+    
+    double start = now_seconds();
+    write_records_stdio(sink, entries, WRITE_BENCH_RECORDS);
+    fflush(sink);
+    double stdio = now_seconds() - start;
+    
+    start = now_seconds();
+    failed |= !write_records(sink, entries, WRITE_BENCH_RECORDS);
+    double buffered = now_seconds() - start;
+    
+    printf("  stdio per field  %8.2f M records/s\n", WRITE_BENCH_RECORDS / stdio / 1e6);
+    printf("  record_writer    %8.2f M records/s\n", WRITE_BENCH_RECORDS / buffered / 1e6);
+    
+    fclose(sink);
+    free(entries);
+    return failed;
+}
+
+// Best time of a few rounds of one pipeline stage
+typedef struct {
+    double strip, labels, parse, order, format;
+} StageTimes;
+
+static void keep_best(double *best, double elapsed) {
+    if (*best == 0 || elapsed < *best) *best = elapsed;
+}
+
+// Time every ex1 stage on one generated corpus and print a table row.
+// Returns 1 on failure.
+static int bench_pipeline_case(const CorpusParams *params) {
+    size_t len;
+    char *input = corpus_generate(params, &len);
+    char *clean = (char *)malloc(len + 1);
+    if (input == NULL || clean == NULL) {
+        printf("Memory allocation failed\n");
+        free(input);
+        free(clean);
+        return 1;
+    }
+    
+    StageTimes best = {0, 0, 0, 0, 0};
+    size_t clean_len = 0, out_len = 0;
+    size_t kept = 0;
+    int failed = 0;
+    
+    for (int r = 0; r < PIPELINE_ROUNDS && !failed; r++) {
+        double start = now_seconds();
+        clean_len = strip_corruption(input, len, clean);
+        clean[clean_len] = '\0';
+        keep_best(&best.strip, now_seconds() - start);
+        
+        LabelScan scan = {NULL, 0, 0};
+        start = now_seconds();
+        failed |= !scan_labels(&scan, clean, clean_len);
+        keep_best(&best.labels, now_seconds() - start);
+        free_label_scan(&scan);
+        
+        // parse_entries scans the labels again, so this is the whole parse
+        EntryList list;
+        start = now_seconds();
+        if (!parse_entries(clean, clean_len, &list)) {
+            failed = 1;
+            break;
+        }
+        keep_best(&best.parse, now_seconds() - start);
+        kept = list.count;
+        
+        Entry *ordered = (Entry *)malloc((list.count + 1) * sizeof(Entry));
+        size_t bound = 1;
+        for (size_t i = 0; i < list.count; i++) {
+            bound += record_max_length(&list.entries[i]);
+        }
+        char *out = (char *)malloc(bound);
+        if (ordered == NULL || out == NULL) {
+            printf("Memory allocation failed\n");
+            failed = 1;
+        } else {
+            start = now_seconds();
+            order_entries_into(list.entries, list.count, ordered);
+            keep_best(&best.order, now_seconds() - start);
+            
+            start = now_seconds();
+            char *end = out;
+            for (size_t i = 0; i < list.count; i++) {
+                end = format_record(end, &ordered[i]);
+            }
+            keep_best(&best.format, now_seconds() - start);
+            out_len = (size_t)(end - out);
+        }
+        free(ordered);
+        free(out);
+        free_entry_list(&list);
+    }
+    
+    if (!failed) {
+        double records = (double)params->records;
+        double kept_records = (double)kept;
+        printf("  %9zu %4d%% %4d%% %4d%% %4d%% %8.0f %8.0f %8.0f %6.2f %8.1f %8.0f %6.2f\n",
+               params->records, params->corruption_percent, params->label_space_percent,
+               params->duplicate_percent, params->bad_fingerprint_percent,
+               len / best.strip / 1e6, clean_len / best.labels / 1e6,
+               clean_len / best.parse / 1e6, records / best.parse / 1e6,
+               kept_records / best.order / 1e6, out_len / best.format / 1e6, kept_records / best.format / 1e6);
+    }
+    free(input);
+    free(clean);
+    return failed;
+}
+
+// MB/s and records/s of each ex1 stage, on generated corpora where one
+// parameter at a time moves away from a moderately corrupted baseline
+static int bench_pipeline(size_t records) {
+    CorpusParams base;
+    corpus_default_params(&base, 42);
+    base.records = records;
+    base.corruption_percent = 10;
+    base.label_space_percent = 10;
+    base.duplicate_percent = 10;
+    base.bad_fingerprint_percent = 2;
+    
+    strip_init();
+    label_scan_init();
+    printf("pipeline: best of %d rounds, MB/s of each stage's input unless noted\n", PIPELINE_ROUNDS);
+    printf("  %9s %5s %5s %5s %5s %8s %8s %8s %6s %8s %8s %6s\n", "records", "corr", "space", "dups",
+           "badfp", "strip", "labels", "parse", "Mrec/s", "order", "format", "Mrec/s");
+    printf("  %9s %5s %5s %5s %5s %8s %8s %8s %6s %8s %8s %6s\n", "", "", "", "", "",
+           "", "", "", "", "Mrec/s", "MB out", "");
+    
+    int failed = 0;
+    static const size_t sizes[] = {1000, 100000};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        if (sizes[i] >= records) break;
+        CorpusParams params = base;
+        params.records = sizes[i];
+        failed |= bench_pipeline_case(&params);
+    }
+    failed |= bench_pipeline_case(&base);
+    
+    static const int levels[] = {0, 50};
+    for (int knob = 0; knob < 4; knob++) {
+        for (int l = 0; l < 2; l++) {
+            CorpusParams params = base;
+            int *value = knob == 0 ? &params.corruption_percent
+                       : knob == 1 ? &params.label_space_percent
+                       : knob == 2 ? &params.duplicate_percent
+                       : &params.bad_fingerprint_percent;
+            *value = levels[l];
+            failed |= bench_pipeline_case(&params);
+        }
+    }
+    return failed;
+}
+
+int main(int argc, char **argv) {
+    const char *which = argc > 1 ? argv[1] : "all";
+    int all = strcmp(which, "all") == 0;
+    int failed = 0;
+    
+    if (all || strcmp(which, "strip") == 0) {
+        failed |= bench_strip();
+    }
+    if (all || strcmp(which, "dedup") == 0) {
+        failed |= bench_dedup();
+    }
+    if (all || strcmp(which, "write") == 0) {
+        failed |= bench_write();
+    }
+    if (all || strcmp(which, "pipeline") == 0) {
+        size_t records = argc > 2 ? strtoull(argv[2], NULL, 10) : PIPELINE_RECORDS;
+        failed |= bench_pipeline(records > 0 ? records : PIPELINE_RECORDS);
+    }
+    
+    return failed;
+}
@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <string.h>
+#include "clean_binary.h"
+#include "record_writer.h"
+#include "strip.h"
+
+// Length of a value once its newlines (and corruption) are dropped, plus the
+// terminator
+static size_t stored_length(const char *value, size_t len) {
+    size_t n = len + 1;
+    for (size_t i = 0; i < len; i++) {
+        n -= value[i] == '\n' || value[i] == '\r' || corruption_table[(unsigned char)value[i]];
+    }
+    return n;
+}
+
+// Append a value to the string table, dropping what the text writer drops
+static void put_string(RecordWriter *writer, const char *value, size_t len) {
+    size_t start = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (value[i] == '\n' || value[i] == '\r' || corruption_table[(unsigned char)value[i]]) {
+            record_writer_put_bytes(writer, value + start, i - start);
+            start = i + 1;
+        }
+    }
+    record_writer_put_bytes(writer, value + start, len - start);
+    record_writer_put_bytes(writer, "", 1);
+}
+
+int write_binary_records(FILE *fp, const Entry *entries, size_t count) {
+    // Size the string table first, so the header can go out before it
+    uint64_t strings_size = 0;
+    for (size_t i = 0; i < count; i++) {
+        const Entry *entry = &entries[i];
+        strings_size += stored_length(entry->text, entry->first_len);
+        strings_size += stored_length(entry->text + entry->second_offset, entry->second_len);
+        if (entry->pos_type == UNKNOWN) {
+            strings_size += stored_length(entry->text + entry->position_offset, entry->position_len);
+        }
+    }
+    if (strings_size > UINT32_MAX) {
+        printf("Output too large for the binary format\n");
+        return 0;
+    }
+    
+    RecordWriter writer;
+    if (!record_writer_init(&writer, fp, RECORD_WRITER_BUFFER_SIZE)) {
+        printf("Memory allocation failed\n");
+        return 0;
+    }
+    
+    CleanBinaryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CLEAN_BINARY_MAGIC, sizeof(header.magic));
+    header.version = CLEAN_BINARY_VERSION;
+    header.record_size = sizeof(CleanBinaryRecord);
+    header.record_count = count;
+    header.strings_size = strings_size;
+    record_writer_put_bytes(&writer, (const char *)&header, sizeof(header));
+    
+    uint32_t offset = 0;
+    for (size_t i = 0; i < count; i++) {
+        const Entry *entry = &entries[i];
+        CleanBinaryRecord record;
+        memset(&record, 0, sizeof(record));
+        record.fingerprint = entry->fingerprint;
+        record.pos_type = entry->pos_type;
+        record.first_name = offset;
+        offset += (uint32_t)stored_length(entry->text, entry->first_len);
+        record.second_name = offset;
+        offset += (uint32_t)stored_length(entry->text + entry->second_offset, entry->second_len);
+        if (entry->pos_type == UNKNOWN) {
+            record.position = offset;
+            offset += (uint32_t)stored_length(entry->text + entry->position_offset, entry->position_len);
+        }
+        record_writer_put_bytes(&writer, (const char *)&record, sizeof(record));
+    }
+    
+    for (size_t i = 0; i < count; i++) {
+        const Entry *entry = &entries[i];
+        put_string(&writer, entry->text, entry->first_len);
+        put_string(&writer, entry->text + entry->second_offset, entry->second_len);
+        if (entry->pos_type == UNKNOWN) {
+            put_string(&writer, entry->text + entry->position_offset, entry->position_len);
+        }
+    }
+    
+    return record_writer_close(&writer);
+}
@@ -0,0 +1,41 @@
+#ifndef CLEAN_BINARY_H
+#define CLEAN_BINARY_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "entry.h"
+
+/* Compact binary form of a clean-record file, for loaders that should not
+   have to parse text. Layout, in native byte order:
+     CleanBinaryHeader
+     record_count CleanBinaryRecord
+     strings_size bytes of NUL-terminated strings
+   A text clean file starts with "First Name: " (or is empty), so the magic
+   tells the two apart. */
+
+#define CLEAN_BINARY_MAGIC "CLEANREC"
+#define CLEAN_BINARY_VERSION 1
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;       /* sizeof(CleanBinaryRecord) */
+    uint64_t record_count;
+    uint64_t strings_size;
+} CleanBinaryHeader;
+
+typedef struct {
+    uint64_t fingerprint;       /* packed, see fingerprint.h */
+    uint32_t first_name;        /* offsets into the string table */
+    uint32_t second_name;
+    uint32_t position;          /* only used for UNKNOWN positions */
+    uint8_t pos_type;           /* PositionType */
+    uint8_t reserved[3];
+} CleanBinaryRecord;
+
+/* Writes entries, in order, to fp in the binary format. Returns 0 on
+   failure. */
+int write_binary_records(FILE *fp, const Entry *entries, size_t count);
+
+#endif // CLEAN_BINARY_H
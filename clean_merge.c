@@ -0,0 +1,329 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "clean_merge.h"
+#include "cleaner.h"
+#include "record_writer.h"
+#include "fingerprint.h"
+
+#define SHARD_READ_SIZE (64 * 1024)
+
+// Sequential reader of the records of one clean file. A record is the four
+// "Label: value" lines and the blank line ex1 writes after them; values
+// never contain a newline, so the first "\n\n" ends it.
+typedef struct {
+    const char *path;
+    FILE *fp;
+    char *buffer;
+    size_t start;           // first byte of the unread records
+    size_t scanned;         // bytes after start already searched for "\n\n"
+    size_t end;             // end of the buffered bytes
+    size_t capacity;
+    int at_eof;
+    
+    // The current record
+    const char *record;
+    size_t record_len;
+    uint64_t fingerprint;
+    PositionType bucket;
+    size_t index;           // number of the record in the file
+} ShardReader;
+
+static int open_shard(ShardReader *reader, const char *path) {
+    memset(reader, 0, sizeof(*reader));
+    reader->path = path;
+    reader->fp = fopen(path, "rb");
+    if (reader->fp == NULL) {
+        printf("Error opening file: %s\n", path);
+        return 0;
+    }
+    reader->capacity = 2 * SHARD_READ_SIZE;
+    reader->buffer = (char *)malloc(reader->capacity);
+    if (reader->buffer == NULL) {
+        printf("Memory allocation failed\n");
+        fclose(reader->fp);
+        reader->fp = NULL;
+        return 0;
+    }
+    reader->index = (size_t)-1;
+    return 1;
+}
+
+static void close_shard(ShardReader *reader) {
+    if (reader->fp != NULL) {
+        fclose(reader->fp);
+    }
+    free(reader->buffer);
+    reader->fp = NULL;
+    reader->buffer = NULL;
+}
+
+// Value of the line of record that starts with label, or NULL
+static const char *find_value(const char *record, size_t len, const char *label, size_t *value_len) {
+    size_t label_len = strlen(label);
+    const char *line = record;
+    const char *end = record + len;
+    while (line < end) {
+        const char *eol = (const char *)memchr(line, '\n', (size_t)(end - line));
+        if (eol == NULL) eol = end;
+        if ((size_t)(eol - line) >= label_len && memcmp(line, label, label_len) == 0) {
+            *value_len = (size_t)(eol - line) - label_len;
+            return line + label_len;
+        }
+        line = eol + 1;
+    }
+    return NULL;
+}
+
+// Fill the fingerprint and bucket of the current record, returns 0 if it
+// is not a clean record
+static int decode_record(ShardReader *reader) {
+    size_t len;
+    const char *fingerprint = find_value(reader->record, reader->record_len, "Fingerprint: ", &len);
+    if (fingerprint == NULL || len != FINGERPRINT_LEN) {
+        return 0;
+    }
+    reader->fingerprint = pack_fingerprint(fingerprint);
+    
+    const char *position = find_value(reader->record, reader->record_len, "Position: ", &len);
+    if (position == NULL || reader->fingerprint == 0) {
+        return 0;
+    }
+    reader->bucket = get_position_type(position, len);
+    return 1;
+}
+
+// Advance to the next record. Returns 1 if there is one, 0 at the end of
+// the file and -1 on error (already reported).
+static int next_record(ShardReader *reader) {
+    for (;;) {
+        // Look for the blank line that ends the record
+        const char *from = reader->buffer + reader->start + reader->scanned;
+        const char *limit = reader->buffer + reader->end;
+        const char *nl = from;
+        while ((nl = (const char *)memchr(nl, '\n', (size_t)(limit - nl))) != NULL && nl + 1 < limit) {
+            if (nl[1] == '\n') break;
+            nl++;
+        }
+        if (nl != NULL && nl + 1 < limit) {
+            reader->record = reader->buffer + reader->start;
+            reader->record_len = (size_t)(nl + 2 - reader->record);
+            reader->start += reader->record_len;
+            reader->scanned = 0;
+            reader->index++;
+            if (!decode_record(reader)) {
+                printf("Invalid clean file: %s\n", reader->path);
+                return -1;
+            }
+            return 1;
+        }
+        // A lone '\n' at the end may be the first half of the terminator
+        reader->scanned = reader->end - reader->start;
+        if (reader->scanned > 0) reader->scanned--;
+        
+        if (reader->at_eof) {
+            if (reader->start != reader->end) {
+                printf("Invalid clean file: %s\n", reader->path);
+                return -1;
+            }
+            return 0;
+        }
+        
+        // Keep the partial record and read more after it
+        memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+        if (reader->capacity - reader->end < SHARD_READ_SIZE) {
+            char *temp = (char *)realloc(reader->buffer, reader->capacity * 2);
+            if (temp == NULL) {
+                printf("Memory allocation failed\n");
+                return -1;
+            }
+            reader->buffer = temp;
+            reader->capacity *= 2;
+        }
+        size_t n = fread(reader->buffer + reader->end, 1, reader->capacity - reader->end, reader->fp);
+        if (n == 0) {
+            if (ferror(reader->fp)) {
+                printf("Error reading file: %s\n", reader->path);
+                return -1;
+            }
+            reader->at_eof = 1;
+        }
+        reader->end += n;
+    }
+}
+
+// Growable bit array, one bit per record of a shard
+typedef struct {
+    uint8_t *bits;
+    size_t count;
+    size_t capacity;        // in bytes
+} KeepBits;
+
+static int push_keep_bit(KeepBits *keep, int bit) {
+    if (keep->count / 8 >= keep->capacity) {
+        size_t capacity = keep->capacity ? keep->capacity * 2 : 1024;
+        uint8_t *temp = (uint8_t *)realloc(keep->bits, capacity);
+        if (temp == NULL) {
+            printf("Memory allocation failed\n");
+            return 0;
+        }
+        memset(temp + keep->capacity, 0, capacity - keep->capacity);
+        keep->bits = temp;
+        keep->capacity = capacity;
+    }
+    if (bit) {
+        keep->bits[keep->count / 8] |= (uint8_t)(1u << (keep->count % 8));
+    }
+    keep->count++;
+    return 1;
+}
+
+static inline int keep_bit(const KeepBits *keep, size_t index) {
+    return (keep->bits[index / 8] >> (index % 8)) & 1;
+}
+
+// Pass 1: walk the shards in dump order and keep a record only if no
+// earlier shard had its fingerprint. Each shard was deduplicated when it
+// was cleaned, so the set can be filled while the shard is checked. Also
+// makes sure every shard is sorted, which the merge relies on.
+static int mark_first_occurrences(char *const *inputs, size_t count, KeepBits *keep) {
+    FpSet seen;
+    if (!fp_set_init(&seen, 1024)) {
+        printf("Memory allocation failed\n");
+        return 0;
+    }
+    
+    int ok = 1;
+    for (size_t k = 0; k < count && ok; k++) {
+        ShardReader reader;
+        if (!open_shard(&reader, inputs[k])) {
+            ok = 0;
+            break;
+        }
+        PositionType previous = BOSS;
+        int status;
+        while ((status = next_record(&reader)) == 1) {
+            if (reader.bucket < previous) {
+                printf("Clean file is not sorted by position: %s\n", inputs[k]);
+                status = -1;
+                break;
+            }
+            previous = reader.bucket;
+            int added = fp_set_insert(&seen, reader.fingerprint);
+            if (added < 0) {
+                printf("Memory allocation failed\n");
+                status = -1;
+                break;
+            }
+            if (!push_keep_bit(&keep[k], added)) {
+                status = -1;
+                break;
+            }
+        }
+        ok = status == 0;
+        close_shard(&reader);
+    }
+    
+    fp_set_free(&seen);
+    return ok;
+}
+
+// Pass 2: repeatedly take the shard whose next record has the lowest
+// position (the first such shard on a tie) and copy its run of records of
+// that position, skipping the ones pass 1 dropped
+static int merge_shards(ShardReader *readers, const KeepBits *keep, size_t count, RecordWriter *writer) {
+    int *status = (int *)malloc(count * sizeof(int));
+    if (status == NULL) {
+        printf("Memory allocation failed\n");
+        return 0;
+    }
+    int ok = 1;
+    for (size_t k = 0; k < count && ok; k++) {
+        status[k] = next_record(&readers[k]);
+        ok = status[k] >= 0;
+    }
+    
+    while (ok) {
+        size_t best = count;
+        for (size_t k = 0; k < count; k++) {
+            if (status[k] == 1 && (best == count || readers[k].bucket < readers[best].bucket)) {
+                best = k;
+            }
+        }
+        if (best == count) break;
+        
+        ShardReader *reader = &readers[best];
+        PositionType bucket = reader->bucket;
+        do {
+            if (reader->index >= keep[best].count) {
+                printf("Clean file changed while merging: %s\n", reader->path);
+                ok = 0;
+                break;
+            }
+            if (keep_bit(&keep[best], reader->index)) {
+                record_writer_put_bytes(writer, reader->record, reader->record_len);
+            }
+            status[best] = next_record(reader);
+            ok = status[best] >= 0;
+        } while (ok && status[best] == 1 && reader->bucket == bucket);
+    }
+    
+    free(status);
+    return ok;
+}
+
+int merge_clean_files(char *const *inputs, size_t count, const char *output) {
+    KeepBits *keep = (KeepBits *)calloc(count ? count : 1, sizeof(KeepBits));
+    ShardReader *readers = (ShardReader *)calloc(count ? count : 1, sizeof(ShardReader));
+    if (keep == NULL || readers == NULL) {
+        printf("Memory allocation failed\n");
+        free(keep);
+        free(readers);
+        return 0;
+    }
+    
+    int ok = mark_first_occurrences(inputs, count, keep);
+    size_t opened = 0;
+    while (ok && opened < count) {
+        ok = open_shard(&readers[opened], inputs[opened]);
+        if (ok) opened++;
+    }
+    
+    FILE *fp = NULL;
+    if (ok) {
+        fp = fopen(output, "w");
+        if (fp == NULL) {
+            printf("Error opening file: %s\n", output);
+            ok = 0;
+        }
+    }
+    if (ok) {
+        RecordWriter writer;
+        if (!record_writer_init(&writer, fp, RECORD_WRITER_BUFFER_SIZE)) {
+            printf("Memory allocation failed\n");
+            ok = 0;
+        } else {
+            ok = merge_shards(readers, keep, count, &writer);
+            if (!record_writer_close(&writer) && ok) {
+                printf("Error writing file: %s\n", output);
+                ok = 0;
+            }
+        }
+        if (fclose(fp) != 0 && ok) {
+            printf("Error writing file: %s\n", output);
+            ok = 0;
+        }
+    }
+    
+    for (size_t k = 0; k < opened; k++) {
+        close_shard(&readers[k]);
+    }
+    for (size_t k = 0; k < count; k++) {
+        free(keep[k].bits);
+    }
+    free(readers);
+    free(keep);
+    return ok;
+}
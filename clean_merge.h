@@ -0,0 +1,19 @@
+#ifndef CLEAN_MERGE_H
+#define CLEAN_MERGE_H
+
+#include <stddef.h>
+
+/* Merges the clean text files ex1 wrote for consecutive shards of one dump
+   (inputs[0] holding the start of the dump) into output, which then reads
+   exactly as if ex1 had cleaned the whole dump at once: records ordered by
+   position, then by their order in the dump, and a fingerprint seen in
+   several shards kept only from the first of them.
+
+   The inputs are streamed twice. The first pass reads only fingerprints
+   and decides which records survive (one bit per record); the second is a
+   k-way merge on (position, shard) that copies the surviving records
+   through unchanged. Memory holds the distinct fingerprints and a read
+   buffer per shard, never a whole shard. Returns 0 on failure. */
+int merge_clean_files(char *const *inputs, size_t count, const char *output);
+
+#endif // CLEAN_MERGE_H
@@ -0,0 +1,938 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include "cleaner.h"
+#include "strip.h"
+#include "fingerprint.h"
+#include "record_writer.h"
+
+#define STREAM_CHUNK_SIZE (64 * 1024)
+#define STRING_ARENA_BLOCK_SIZE (1024 * 1024)
+
+// Whitespace, or corruption still present in unstripped text
+static inline int is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || corruption_table[(unsigned char)c];
+}
+
+// Get position type from a position value, ignoring the newlines (and any
+// corruption) in it
+PositionType get_position_type(const char *pos, size_t len) {
+    // The longest known position is "Support_Right"
+    char buffer[16];
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (pos[i] == '\n' || pos[i] == '\r' || corruption_table[(unsigned char)pos[i]]) continue;
+        if (n == sizeof(buffer) - 1) return UNKNOWN;
+        buffer[n++] = pos[i];
+    }
+    buffer[n] = '\0';
+    
+    if (strcmp(buffer, "Boss") == 0) return BOSS;
+    if (strcmp(buffer, "Right Hand") == 0) return RIGHT_HAND;
+    if (strcmp(buffer, "Left Hand") == 0) return LEFT_HAND;
+    if (strcmp(buffer, "Support_Right") == 0) return SUPPORT_RIGHT;
+    if (strcmp(buffer, "Support_Left") == 0) return SUPPORT_LEFT;
+    return UNKNOWN;
+}
+
+// Trim the whitespace around the value between start and end. Newlines
+// (and corruption, in unstripped text) inside the value are kept in the view
+// and dropped when it is written.
+static void trim_value(const char **start, const char **end) {
+    const char *s = *start;
+    const char *e = *end;
+    
+    // Skip leading whitespace
+    while (s < e && is_blank(*s)) {
+        s++;
+    }
+    
+    // Skip trailing whitespace
+    while (e > s && is_blank(*(e - 1))) {
+        e--;
+    }
+    
+    *start = s;
+    *end = e;
+}
+
+// End of the text in text[0..len): its first NUL if it holds one, as for a
+// file
+static const char *text_bound(const char *text, size_t len) {
+    const char *nul = (const char *)memchr(text, '\0', len);
+    return nul != NULL ? nul : text + len;
+}
+
+// Initialize an empty entry list, returns 0 on allocation failure
+int init_entry_list(EntryList *list) {
+    list->count = 0;
+    list->capacity = 10;
+    list->order_counter = 0;
+    memset(&list->counters, 0, sizeof(list->counters));
+    list->copy_text = 0;
+    arena_init(&list->strings, STRING_ARENA_BLOCK_SIZE);
+    list->labels.hits = NULL;
+    list->labels.count = 0;
+    list->labels.capacity = 0;
+    list->entries = (Entry *)malloc(list->capacity * sizeof(Entry));
+    if (list->entries == NULL) {
+        printf("Memory allocation failed\n");
+        return 0;
+    }
+    if (!fp_set_init(&list->seen, list->capacity)) {
+        printf("Memory allocation failed\n");
+        free(list->entries);
+        return 0;
+    }
+    return 1;
+}
+
+// Empty a list for the next input, keeping every buffer it has grown
+void reset_entry_list(EntryList *list) {
+    list->count = 0;
+    list->order_counter = 0;
+    memset(&list->counters, 0, sizeof(list->counters));
+    arena_reset(&list->strings);
+    fp_set_clear(&list->seen);
+}
+
+// Free the parse-only state of a list, once no more text will be added
+void finish_entry_list(EntryList *list) {
+    fp_set_free(&list->seen);
+    free_label_scan(&list->labels);
+}
+
+// Free the entries of a list, their copied text and its scratch buffers
+void free_entry_list(EntryList *list) {
+    free(list->entries);
+    arena_free(&list->strings);
+    finish_entry_list(list);
+}
+
+// One record as located in the text, before dedup
+typedef struct {
+    const char *first_start, *first_end;
+    const char *second_start, *second_end;
+    const char *position_start, *position_end;
+    uint64_t fingerprint;
+    const char *next;       // where parsing continues, see parse_record
+} ParsedRecord;
+
+// Outcome of parse_record
+typedef enum {
+    RECORD_OK,              // record filled; next is the following "FirstName:" or NULL at the end
+    RECORD_BAD_FINGERPRINT, // not exactly 9 alphanumerics; next is just past them
+    RECORD_END,             // a label is missing: nothing more can be parsed
+    RECORD_NEED_MORE        // only a prefix of the input is known and the record runs past it
+} RecordStatus;
+
+// Parse the record whose "FirstName:" label is first_name_label. *cursor
+// must be just past that label in labels and is advanced as labels are used.
+// Corruption characters are stepped over wherever they appear, so the text
+// may be the raw input as well as its stripped copy.
+static RecordStatus parse_record(const char *text, const char *text_end, const LabelScan *labels,
+                                 size_t *cursor, const LabelHit *first_name_label, int at_eof,
+                                 ParsedRecord *record) {
+    // Skip past the label
+    const char *ptr = text + first_name_label->end;
+    
+    // Find "SecondName:"
+    const LabelHit *second_name_label = next_label(labels, cursor, LABEL_SECOND_NAME, ptr - text);
+    if (second_name_label == NULL) return RECORD_END;
+    
+    // First name runs up to the label
+    record->first_start = ptr;
+    record->first_end = text + second_name_label->start;
+    trim_value(&record->first_start, &record->first_end);
+    
+    // Skip past "SecondName:"
+    ptr = text + second_name_label->end;
+    
+    // Find "Fingerprint:"
+    const LabelHit *fingerprint_label = next_label(labels, cursor, LABEL_FINGERPRINT, ptr - text);
+    if (fingerprint_label == NULL) return RECORD_END;
+    
+    // Second name runs up to the label
+    record->second_start = ptr;
+    record->second_end = text + fingerprint_label->start;
+    trim_value(&record->second_start, &record->second_end);
+    
+    // Skip past "Fingerprint:"
+    ptr = text + fingerprint_label->end;
+    
+    // Skip whitespace before fingerprint
+    while (ptr < text_end && is_blank(*ptr)) ptr++;
+    
+    // Extract fingerprint (exactly 9 alphanumeric characters, stepping over
+    // any corruption between them)
+    char fingerprint[FINGERPRINT_LEN];
+    int fp_len = 0;
+    while (fp_len < FINGERPRINT_LEN && ptr < text_end) {
+        if (corruption_table[(unsigned char)*ptr]) {
+            ptr++;
+        } else if (isalnum((unsigned char)*ptr)) {
+            fingerprint[fp_len++] = *ptr++;
+        } else {
+            break;
+        }
+    }
+    
+    if (fp_len != FINGERPRINT_LEN) {
+        // The fingerprint may continue in the next chunk
+        if (!at_eof && ptr == text_end) return RECORD_NEED_MORE;
+        record->next = ptr;
+        return RECORD_BAD_FINGERPRINT;
+    }
+    record->fingerprint = pack_fingerprint(fingerprint);
+    
+    // Find "Position:"
+    const LabelHit *position_label = next_label(labels, cursor, LABEL_POSITION, ptr - text);
+    if (position_label == NULL) return RECORD_END;
+    
+    // Skip past "Position:"
+    ptr = text + position_label->end;
+    
+    // Find next "FirstName:" or end of string
+    const LabelHit *next_label_hit = next_label(labels, cursor, LABEL_FIRST_NAME, ptr - text);
+    record->next = next_label_hit ? text + next_label_hit->start : NULL;
+    if (record->next == NULL && !at_eof) {
+        // The position may continue in the next chunk
+        return RECORD_NEED_MORE;
+    }
+    if (next_label_hit != NULL) {
+        // The hit is searched again as the start of the next record
+        (*cursor)--;
+    }
+    
+    // Position runs up to the next record
+    record->position_start = ptr;
+    record->position_end = record->next ? record->next : text_end;
+    trim_value(&record->position_start, &record->position_end);
+    
+    return RECORD_OK;
+}
+
+// Views are 32-bit offsets into the record's span, so longer records are dropped
+static int record_fits(const ParsedRecord *record) {
+    if ((size_t)(record->position_end - record->first_start) > UINT32_MAX) {
+        printf("Record too long, skipped\n");
+        return 0;
+    }
+    return 1;
+}
+
+// Fill an entry with views into the span that starts at span
+static void fill_entry(Entry *entry, const ParsedRecord *record, const char *span) {
+    const char *base = record->first_start;
+    entry->text = span;
+    entry->fingerprint = record->fingerprint;
+    entry->first_len = (uint32_t)(record->first_end - base);
+    entry->second_offset = (uint32_t)(record->second_start - base);
+    entry->second_len = (uint32_t)(record->second_end - record->second_start);
+    entry->position_offset = (uint32_t)(record->position_start - base);
+    entry->position_len = (uint32_t)(record->position_end - record->position_start);
+    entry->pos_type = (uint8_t)get_position_type(record->position_start, entry->position_len);
+}
+
+// Append an accepted record to the list, returns 0 on allocation failure
+static int add_entry(EntryList *list, const ParsedRecord *record) {
+    // Expand array if needed
+    if (list->count >= list->capacity) {
+        list->capacity *= 2;
+        Entry *temp = (Entry *)realloc(list->entries, list->capacity * sizeof(Entry));
+        if (temp == NULL) {
+            printf("Memory allocation failed\n");
+            return 0;
+        }
+        list->entries = temp;
+        list->counters.entry_reallocs++;
+    }
+    
+    // The record's text has to outlive a temporary parse buffer
+    const char *span = record->first_start;
+    if (list->copy_text) {
+        size_t span_len = (size_t)(record->position_end - record->first_start);
+        char *copy = arena_alloc(&list->strings, span_len);
+        if (copy == NULL && span_len > 0) {
+            printf("Memory allocation failed\n");
+            return 0;
+        }
+        if (span_len > 0) {
+            memcpy(copy, record->first_start, span_len);
+        }
+        span = copy;
+    }
+    
+    Entry *entry = &list->entries[list->count];
+    fill_entry(entry, record, span);
+    entry->original_order = list->order_counter++;
+    list->count++;
+    return 1;
+}
+
+// Parse as many whole records as possible from cleaned text into list.
+// When at_eof is 0 the text is only a prefix of the input: a record is
+// accepted only once the next "FirstName:" after it has been seen, and any
+// decision that depends on text past the end is postponed.
+// Returns where the next call has to resume (the unconsumed tail of text),
+// or NULL on allocation failure, in which case the list has been freed.
+const char* parse_entries_chunk(EntryList *list, const char *text, size_t len, int at_eof) {
+    const char *ptr = text;
+    const char *resume = text;
+    const char *text_end = text_bound(text, len);
+    
+    // Locate every label once; the loop below only walks forward through them
+    if (!scan_labels(&list->labels, text, (size_t)(text_end - text))) {
+        printf("Memory allocation failed\n");
+        free_entry_list(list);
+        return NULL;
+    }
+    size_t cursor = 0;
+    
+    while (ptr < text_end) {
+        // Look for "FirstName:" (ignoring whitespace)
+        const LabelHit *first_name_label = next_label(&list->labels, &cursor, LABEL_FIRST_NAME, ptr - text);
+        if (first_name_label == NULL) {
+            // Only a label cut off at the end of the text can still match,
+            // and it has to begin at the last 'F'
+            const char *last_f = text_end;
+            while (last_f > ptr && *(last_f - 1) != 'F') last_f--;
+            resume = last_f > ptr ? last_f - 1 : text_end;
+            break;
+        }
+        resume = text + first_name_label->start;
+        
+        ParsedRecord record;
+        RecordStatus status = parse_record(text, text_end, &list->labels, &cursor,
+                                           first_name_label, at_eof, &record);
+        if (status == RECORD_END || status == RECORD_NEED_MORE) {
+            break;
+        }
+        if (status == RECORD_BAD_FINGERPRINT) {
+            list->counters.bad_fingerprints++;
+            ptr = record.next;
+            resume = ptr;
+            continue;
+        }
+        
+        if (record_fits(&record)) {
+            // Check for duplicates; the first occurrence of a fingerprint wins
+            int added = fp_set_insert(&list->seen, record.fingerprint);
+            if (added < 0) {
+                printf("Memory allocation failed\n");
+                free_entry_list(list);
+                return NULL;
+            }
+            list->counters.records_seen++;
+            list->counters.duplicates += !added;
+            if (added && !add_entry(list, &record)) {
+                free_entry_list(list);
+                return NULL;
+            }
+        }
+        
+        // Move to next entry
+        if (record.next == NULL) {
+            resume = text_end;
+            break;
+        }
+        ptr = record.next;
+        resume = ptr;
+    }
+    
+    return resume;
+}
+
+// Parse entries from cleaned text into a new list, returns 0 on failure
+int parse_entries(const char *text, size_t len, EntryList *list) {
+    if (!init_entry_list(list)) {
+        return 0;
+    }
+    
+    if (parse_entries_chunk(list, text, len, 1) == NULL) {
+        return 0;
+    }
+    finish_entry_list(list);
+    return 1;
+}
+
+// ---- Parallel parse -------------------------------------------------------
+//
+// The cleaned text is cut into one shard per thread and handled in phases,
+// each one parallel across shards:
+//   1. every worker finds the labels of its byte range; the ranges are
+//      concatenated into the same label list one scan would give
+//   2. every shard starts at its first "FirstName:" label and parses records
+//      until the next record would start in the following shard
+//   3. the shards are chained in order: if a shard did not stop exactly where
+//      the next one started (a label swallowed by a value, say), the next one
+//      is parsed again from where the previous one really stopped
+//   4. fingerprints are deduplicated per hash partition, each partition
+//      walking all records in input order, so the first occurrence wins
+//   5. the kept records get their original_order and are copied out
+// The result is identical to parse_entries.
+
+typedef struct {
+    // Shared input
+    const char *text;
+    const char *text_end;
+    const LabelScan *labels;
+    
+    // Phase 1: this shard's byte range and the labels found in it
+    size_t range_start;
+    size_t range_end;
+    LabelScan range_labels;
+    
+    // Phase 2: the label indexes bounding the shard, and its records
+    size_t first_hit;
+    size_t stop_hit;
+    Entry *records;
+    size_t count;
+    size_t capacity;
+    size_t bad_fingerprints;
+    int stopped_inside;     // 1 if parsing ended in this shard
+    size_t exit_hit;        // otherwise, the label the next record starts at
+    
+    // Phase 4/5: which records survive dedup, and where they go
+    uint8_t *keep;
+    size_t kept;
+    size_t first_order;
+    
+    int failed;
+} ParseShard;
+
+typedef struct {
+    ParseShard *shards;
+    int shard_count;
+    int partition;
+    Entry *output;
+    int failed;
+} ShardJob;
+
+// Run fn on every job, one thread each (the last one on the calling thread)
+int run_parallel(void *(*fn)(void *), void *jobs, size_t job_size, int count) {
+    pthread_t threads[MAX_PARSE_THREADS];
+    int started = 0;
+    
+    for (int i = 0; i < count - 1; i++) {
+        if (pthread_create(&threads[i], NULL, fn, (char *)jobs + i * job_size) != 0) {
+            break;
+        }
+        started++;
+    }
+    // Whatever could not get a thread runs here
+    for (int i = started; i < count; i++) {
+        fn((char *)jobs + i * job_size);
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    return 1;
+}
+
+static void *scan_shard_labels(void *arg) {
+    ParseShard *shard = (ParseShard *)arg;
+    if (!scan_labels_range(&shard->range_labels, shard->text, (size_t)(shard->text_end - shard->text),
+                           shard->range_start, shard->range_end)) {
+        shard->failed = 1;
+    }
+    return NULL;
+}
+
+// Phase 2 for one shard; also used to redo a shard from another start
+static void *parse_shard(void *arg) {
+    ParseShard *shard = (ParseShard *)arg;
+    const char *text = shard->text;
+    shard->count = 0;
+    shard->bad_fingerprints = 0;
+    shard->stopped_inside = 1;
+    
+    if (shard->first_hit >= shard->labels->count) {
+        return NULL;
+    }
+    
+    size_t cursor = shard->first_hit;
+    const char *ptr = text + shard->labels->hits[shard->first_hit].start;
+    
+    for (;;) {
+        const LabelHit *first_name_label = next_label(shard->labels, &cursor, LABEL_FIRST_NAME, ptr - text);
+        if (first_name_label == NULL) {
+            return NULL;
+        }
+        size_t hit = (size_t)(first_name_label - shard->labels->hits);
+        if (hit >= shard->stop_hit) {
+            // The next record belongs to the following shard
+            shard->stopped_inside = 0;
+            shard->exit_hit = hit;
+            return NULL;
+        }
+        
+        ParsedRecord record;
+        RecordStatus status = parse_record(text, shard->text_end, shard->labels, &cursor,
+                                           first_name_label, 1, &record);
+        if (status == RECORD_END) {
+            return NULL;
+        }
+        if (status == RECORD_BAD_FINGERPRINT) {
+            shard->bad_fingerprints++;
+            ptr = record.next;
+            continue;
+        }
+        
+        if (record_fits(&record)) {
+            if (shard->count >= shard->capacity) {
+                size_t capacity = shard->capacity ? shard->capacity * 2 : 1024;
+                Entry *temp = (Entry *)realloc(shard->records, capacity * sizeof(Entry));
+                if (temp == NULL) {
+                    shard->failed = 1;
+                    return NULL;
+                }
+                shard->records = temp;
+                shard->capacity = capacity;
+            }
+            fill_entry(&shard->records[shard->count++], &record, record.first_start);
+        }
+        
+        if (record.next == NULL) {
+            return NULL;
+        }
+        ptr = record.next;
+    }
+}
+
+// Hash partition of a fingerprint for the parallel dedup
+static inline int fingerprint_partition(uint64_t key, int partitions) {
+    return (int)(((key * 0x9E3779B97F4A7C15ULL) >> 32) % (uint64_t)partitions);
+}
+
+static void *dedup_partition(void *arg) {
+    ShardJob *job = (ShardJob *)arg;
+    FpSet seen;
+    if (!fp_set_init(&seen, 1024)) {
+        job->failed = 1;
+        return NULL;
+    }
+    
+    for (int k = 0; k < job->shard_count; k++) {
+        ParseShard *shard = &job->shards[k];
+        for (size_t i = 0; i < shard->count; i++) {
+            uint64_t key = shard->records[i].fingerprint;
+            if (fingerprint_partition(key, job->shard_count) != job->partition) continue;
+            int added = fp_set_insert(&seen, key);
+            if (added < 0) {
+                job->failed = 1;
+                fp_set_free(&seen);
+                return NULL;
+            }
+            shard->keep[i] = (uint8_t)added;
+        }
+    }
+    
+    fp_set_free(&seen);
+    return NULL;
+}
+
+static void *count_kept(void *arg) {
+    ParseShard *shard = (ParseShard *)arg;
+    shard->kept = 0;
+    for (size_t i = 0; i < shard->count; i++) {
+        shard->kept += shard->keep[i];
+    }
+    return NULL;
+}
+
+static void *emit_kept(void *arg) {
+    ShardJob *job = (ShardJob *)arg;
+    ParseShard *shard = &job->shards[job->partition];
+    Entry *out = job->output + shard->first_order;
+    size_t order = shard->first_order;
+    for (size_t i = 0; i < shard->count; i++) {
+        if (!shard->keep[i]) continue;
+        *out = shard->records[i];
+        out->original_order = order++;
+        out++;
+    }
+    return NULL;
+}
+
+static void free_shards(ParseShard *shards, int count) {
+    for (int k = 0; k < count; k++) {
+        free_label_scan(&shards[k].range_labels);
+        free(shards[k].records);
+        free(shards[k].keep);
+    }
+    free(shards);
+}
+
+// Parse cleaned text on several threads into a new list, with the same
+// result as parse_entries. Returns 0 on failure.
+int parse_entries_parallel(const char *text, size_t len, EntryList *list, int thread_count) {
+    if (!init_entry_list(list)) {
+        return 0;
+    }
+    
+    len = (size_t)(text_bound(text, len) - text);
+    ParseShard *shards = (ParseShard *)calloc(thread_count, sizeof(ParseShard));
+    ShardJob *jobs = (ShardJob *)calloc(thread_count, sizeof(ShardJob));
+    if (shards == NULL || jobs == NULL) {
+        printf("Memory allocation failed\n");
+        free(shards);
+        free(jobs);
+        free_entry_list(list);
+        return 0;
+    }
+    
+    // Phase 1: labels of each byte range, then concatenated
+    for (int k = 0; k < thread_count; k++) {
+        shards[k].text = text;
+        shards[k].text_end = text + len;
+        shards[k].labels = &list->labels;
+        shards[k].range_start = len / thread_count * k;
+        shards[k].range_end = (k == thread_count - 1) ? len : len / thread_count * (k + 1);
+    }
+    run_parallel(scan_shard_labels, shards, sizeof(ParseShard), thread_count);
+    
+    size_t total_hits = 0;
+    int failed = 0;
+    for (int k = 0; k < thread_count; k++) {
+        failed |= shards[k].failed;
+        total_hits += shards[k].range_labels.count;
+    }
+    LabelScan *labels = &list->labels;
+    labels->hits = (LabelHit *)malloc((total_hits ? total_hits : 1) * sizeof(LabelHit));
+    if (failed || labels->hits == NULL) {
+        printf("Memory allocation failed\n");
+        free_shards(shards, thread_count);
+        free(jobs);
+        free_entry_list(list);
+        return 0;
+    }
+    labels->capacity = total_hits;
+    for (int k = 0; k < thread_count; k++) {
+        if (shards[k].range_labels.count > 0) {
+            memcpy(labels->hits + labels->count, shards[k].range_labels.hits,
+                   shards[k].range_labels.count * sizeof(LabelHit));
+        }
+        labels->count += shards[k].range_labels.count;
+        free_label_scan(&shards[k].range_labels);
+    }
+    
+    // Phase 2: each shard starts at the first "FirstName:" in its range
+    size_t hit = 0;
+    for (int k = 0; k < thread_count; k++) {
+        while (hit < labels->count &&
+               (labels->hits[hit].start < shards[k].range_start || labels->hits[hit].kind != LABEL_FIRST_NAME)) {
+            hit++;
+        }
+        shards[k].first_hit = hit;
+    }
+    for (int k = 0; k < thread_count; k++) {
+        shards[k].stop_hit = (k == thread_count - 1) ? labels->count : shards[k + 1].first_hit;
+    }
+    run_parallel(parse_shard, shards, sizeof(ParseShard), thread_count);
+    
+    // Phase 3: chain the shards, redoing any that started at the wrong place
+    int used = thread_count;
+    for (int k = 0; k < thread_count; k++) {
+        failed |= shards[k].failed;
+        if (k == thread_count - 1 || failed) break;
+        if (shards[k].stopped_inside) {
+            used = k + 1;
+            break;
+        }
+        if (shards[k].exit_hit != shards[k + 1].first_hit) {
+            shards[k + 1].first_hit = shards[k].exit_hit;
+            parse_shard(&shards[k + 1]);
+        }
+    }
+    
+    // Phase 4: dedup by hash partition, in input order within each
+    for (int k = 0; k < used && !failed; k++) {
+        shards[k].keep = (uint8_t *)calloc(shards[k].count ? shards[k].count : 1, 1);
+        failed |= shards[k].keep == NULL;
+    }
+    if (!failed) {
+        for (int p = 0; p < used; p++) {
+            jobs[p].shards = shards;
+            jobs[p].shard_count = used;
+            jobs[p].partition = p;
+        }
+        run_parallel(dedup_partition, jobs, sizeof(ShardJob), used);
+        for (int p = 0; p < used; p++) {
+            failed |= jobs[p].failed;
+        }
+    }
+    
+    // Phase 5: number and copy out the kept records
+    size_t total = 0;
+    if (!failed) {
+        run_parallel(count_kept, shards, sizeof(ParseShard), used);
+        for (int k = 0; k < used; k++) {
+            shards[k].first_order = total;
+            total += shards[k].kept;
+        }
+        if (total > list->capacity) {
+            Entry *temp = (Entry *)realloc(list->entries, total * sizeof(Entry));
+            if (temp == NULL) {
+                failed = 1;
+            } else {
+                list->entries = temp;
+                list->capacity = total;
+                list->counters.entry_reallocs++;
+            }
+        }
+    }
+    if (!failed) {
+        for (int k = 0; k < used; k++) {
+            jobs[k].output = list->entries;
+        }
+        run_parallel(emit_kept, jobs, sizeof(ShardJob), used);
+        list->count = total;
+        list->order_counter = total;
+        for (int k = 0; k < used; k++) {
+            list->counters.records_seen += shards[k].count;
+            list->counters.bad_fingerprints += shards[k].bad_fingerprints;
+        }
+        list->counters.duplicates = list->counters.records_seen - total;
+    }
+    
+    free_shards(shards, thread_count);
+    free(jobs);
+    if (failed) {
+        printf("Memory allocation failed\n");
+        free_entry_list(list);
+        return 0;
+    }
+    finish_entry_list(list);
+    return 1;
+}
+
+// Read the input in fixed-size chunks, strip corruption and parse records as
+// soon as they are complete. Only the unfinished tail is carried between
+// chunks, so memory depends on the chunk size and the accepted records, not
+// on the input size. Works on pipes, since the input is never seeked.
+// Fills a new list, returns 0 on failure.
+int stream_and_parse(FILE *fp, EntryList *list) {
+    if (!init_entry_list(list)) {
+        return 0;
+    }
+    list->copy_text = 1;
+    
+    char *chunk = (char *)malloc(STREAM_CHUNK_SIZE);
+    size_t carry_capacity = 2 * STREAM_CHUNK_SIZE;
+    char *carry = (char *)malloc(carry_capacity);
+    if (chunk == NULL || carry == NULL) {
+        printf("Memory allocation failed\n");
+        free(chunk);
+        free(carry);
+        free_entry_list(list);
+        return 0;
+    }
+    size_t carry_len = 0;
+    int at_eof = 0;
+    
+    while (!at_eof) {
+        size_t n = fread(chunk, 1, STREAM_CHUNK_SIZE, fp);
+        if (n < STREAM_CHUNK_SIZE) {
+            if (ferror(fp)) {
+                printf("Error reading input\n");
+            }
+            at_eof = 1;
+        }
+        
+        // Make room for the whole chunk plus the terminator
+        if (carry_len + n + 1 > carry_capacity) {
+            while (carry_len + n + 1 > carry_capacity) carry_capacity *= 2;
+            char *temp = (char *)realloc(carry, carry_capacity);
+            if (temp == NULL) {
+                printf("Memory allocation failed\n");
+                free(chunk);
+                free(carry);
+                free_entry_list(list);
+                return 0;
+            }
+            carry = temp;
+        }
+        
+        // The text ends at the first NUL, like in the whole-file path
+        const char *nul = (const char *)memchr(chunk, '\0', n);
+        if (nul != NULL) {
+            n = (size_t)(nul - chunk);
+            at_eof = 1;
+        }
+        size_t kept = strip_corruption(chunk, n, carry + carry_len);
+        list->counters.bytes_read += n;
+        list->counters.bytes_stripped += n - kept;
+        carry_len += kept;
+        carry[carry_len] = '\0';
+        
+        const char *resume = parse_entries_chunk(list, carry, carry_len, at_eof);
+        if (resume == NULL) {
+            free(chunk);
+            free(carry);
+            return 0;
+        }
+        
+        // Keep only the unfinished tail for the next chunk
+        size_t consumed = (size_t)(resume - carry);
+        carry_len -= consumed;
+        memmove(carry, carry + consumed, carry_len + 1);
+    }
+    
+    free(chunk);
+    free(carry);
+    finish_entry_list(list);
+    return 1;
+}
+
+// Order entries by position, keeping the original order inside each position.
+// Entries come out of the parser in original order, so a stable counting pass
+// over the six position buckets gives that order in O(n), with every entry
+// moved exactly once. ordered must have room for count entries.
+void order_entries_into(const Entry *entries, size_t count, Entry *ordered) {
+    // bucket_start[t] is where the next entry of position type t goes
+    size_t bucket_start[UNKNOWN + 1] = {0};
+    for (size_t i = 0; i < count; i++) {
+        bucket_start[entries[i].pos_type]++;
+    }
+    size_t offset = 0;
+    for (int t = BOSS; t <= UNKNOWN; t++) {
+        size_t size = bucket_start[t];
+        bucket_start[t] = offset;
+        offset += size;
+    }
+    
+    for (size_t i = 0; i < count; i++) {
+        ordered[bucket_start[entries[i].pos_type]++] = entries[i];
+    }
+}
+
+// Order entries as order_entries_into does. Returns the reordered array (the
+// input array is freed), or NULL on allocation failure, in which case the
+// input is left untouched.
+Entry* order_entries(Entry *entries, size_t count) {
+    if (count == 0) {
+        return entries;
+    }
+    
+    Entry *ordered = (Entry *)malloc(count * sizeof(Entry));
+    if (ordered == NULL) {
+        printf("Memory allocation failed\n");
+        return NULL;
+    }
+    order_entries_into(entries, count, ordered);
+    
+    free(entries);
+    return ordered;
+}
+
+
+// ---- In-memory API ---------------------------------------------------------
+
+void cleaner_init(void) {
+    strip_init();
+    label_scan_init();
+}
+
+static void *cleaner_alloc(const CleanerAllocator *allocator, size_t size) {
+    if (allocator != NULL && allocator->alloc != NULL) {
+        return allocator->alloc(size, allocator->context);
+    }
+    return malloc(size);
+}
+
+static void cleaner_release(const CleanerAllocator *allocator, void *ptr) {
+    if (allocator != NULL && allocator->release != NULL) {
+        allocator->release(ptr, allocator->context);
+    } else {
+        free(ptr);
+    }
+}
+
+int clean_records(const char *input, size_t len, int threads,
+                  const CleanerAllocator *allocator, CleanResult *result) {
+    result->entries = NULL;
+    result->count = 0;
+    result->text = (char *)cleaner_alloc(allocator, len + 1);
+    if (result->text == NULL) {
+        printf("Memory allocation failed\n");
+        return 0;
+    }
+    
+    // The text ends at the first NUL, like a file does
+    const char *nul = (const char *)memchr(input, '\0', len);
+    if (nul != NULL) {
+        len = (size_t)(nul - input);
+    }
+    size_t cleaned_len = strip_corruption(input, len, result->text);
+    result->text[cleaned_len] = '\0';
+    
+    EntryList list;
+    int parsed = threads > 1 ? parse_entries_parallel(result->text, cleaned_len, &list, threads)
+                             : parse_entries(result->text, cleaned_len, &list);
+    if (!parsed) {
+        cleaner_release(allocator, result->text);
+        result->text = NULL;
+        return 0;
+    }
+    
+    // Order straight into the caller's array
+    if (list.count > 0) {
+        result->entries = (Entry *)cleaner_alloc(allocator, list.count * sizeof(Entry));
+        if (result->entries == NULL) {
+            printf("Memory allocation failed\n");
+            free_entry_list(&list);
+            cleaner_release(allocator, result->text);
+            result->text = NULL;
+            return 0;
+        }
+        order_entries_into(list.entries, list.count, result->entries);
+        result->count = list.count;
+    }
+    
+    free_entry_list(&list);
+    return 1;
+}
+
+void free_clean_result(CleanResult *result, const CleanerAllocator *allocator) {
+    if (result->entries != NULL) {
+        cleaner_release(allocator, result->entries);
+    }
+    if (result->text != NULL) {
+        cleaner_release(allocator, result->text);
+    }
+    result->entries = NULL;
+    result->count = 0;
+    result->text = NULL;
+}
+
+int clean_to_buffer(const char *input, size_t len, int threads,
+                    const CleanerAllocator *allocator, char **output, size_t *output_len) {
+    CleanResult result;
+    if (!clean_records(input, len, threads, allocator, &result)) {
+        return 0;
+    }
+    
+    size_t bound = 1;
+    for (size_t i = 0; i < result.count; i++) {
+        bound += record_max_length(&result.entries[i]);
+    }
+    char *buffer = (char *)cleaner_alloc(allocator, bound);
+    if (buffer == NULL) {
+        printf("Memory allocation failed\n");
+        free_clean_result(&result, allocator);
+        return 0;
+    }
+    
+    char *out = buffer;
+    for (size_t i = 0; i < result.count; i++) {
+        out = format_record(out, &result.entries[i]);
+    }
+    *out = '\0';
+    
+    *output = buffer;
+    *output_len = (size_t)(out - buffer);
+    free_clean_result(&result, allocator);
+    return 1;
+}
@@ -0,0 +1,127 @@
+#ifndef CLEANER_H
+#define CLEANER_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "entry.h"
+#include "arena.h"
+#include "fp_set.h"
+#include "label_scan.h"
+
+#define MAX_PARSE_THREADS 256
+
+/* Cleaning library behind ex1: strips the corruption from a dump, parses
+   its records, drops repeated fingerprints (the first occurrence wins) and
+   orders the rest by position. Call cleaner_init once before anything else. */
+
+/* Memory for the results handed back to the caller (the cleaned text, the
+   record array and the output buffer). Scratch memory used while parsing is
+   always taken from malloc and released before returning. Pass NULL for
+   malloc and free. */
+typedef struct {
+    void *(*alloc)(size_t size, void *context);
+    void (*release)(void *ptr, void *context);
+    void *context;
+} CleanerAllocator;
+
+/* Records of one input in output order. The entries are views into text. */
+typedef struct {
+    Entry *entries;
+    size_t count;
+    char *text;
+} CleanResult;
+
+/* Selects the strip kernel and builds the label automaton. */
+void cleaner_init(void);
+
+/* Cleans len bytes of input into result, parsing on threads threads (1 for
+   the serial parser). Returns 0 on failure. */
+int clean_records(const char *input, size_t len, int threads,
+                  const CleanerAllocator *allocator, CleanResult *result);
+
+/* Releases a result filled by clean_records with the same allocator. */
+void free_clean_result(CleanResult *result, const CleanerAllocator *allocator);
+
+/* Cleans len bytes of input into the text ex1 would write. *output is taken
+   from allocator and holds *output_len bytes plus a terminating NUL.
+   Returns 0 on failure. */
+int clean_to_buffer(const char *input, size_t len, int threads,
+                    const CleanerAllocator *allocator, char **output, size_t *output_len);
+
+/* ---- Building blocks, for callers that manage their own buffers ---- */
+
+/* What one parse ran into. Counting costs a few increments per record. */
+typedef struct {
+    size_t bytes_read;          /* input bytes, corruption included */
+    size_t bytes_stripped;      /* corruption bytes removed */
+    size_t records_seen;        /* complete records with a valid fingerprint */
+    size_t duplicates;          /* of those, dropped for a repeated fingerprint */
+    size_t bad_fingerprints;    /* records skipped for a malformed fingerprint */
+    size_t entry_reallocs;      /* times the entries array was grown */
+} CleanCounters;
+
+/* Growable list of accepted entries, plus the state needed to keep parsing
+   across several calls (dedup and order numbering span all of them).
+   Entries point into the parsed text. When that text is only a temporary
+   buffer (copy_text set), each accepted record is copied into the arena. */
+typedef struct {
+    Entry *entries;
+    size_t count;
+    size_t capacity;
+    size_t order_counter;
+    int copy_text;
+    Arena strings;
+    FpSet seen;
+    LabelScan labels;
+    CleanCounters counters;
+} EntryList;
+
+/* Initializes an empty entry list, returns 0 on allocation failure. */
+int init_entry_list(EntryList *list);
+
+/* Empties a list for the next input, keeping every buffer it has grown. */
+void reset_entry_list(EntryList *list);
+
+/* Frees the parse-only state of a list, once no more text will be added. */
+void finish_entry_list(EntryList *list);
+
+/* Frees the entries of a list, their copied text and its scratch buffers. */
+void free_entry_list(EntryList *list);
+
+/* Position type of a position value, ignoring the newlines in it. */
+PositionType get_position_type(const char *pos, size_t len);
+
+/* The parsers below read text[0..len), which ends early at a NUL byte if
+   it holds one, and never look at text[len]. */
+
+/* Parses as many whole records as possible from cleaned text into list.
+   When at_eof is 0 the text is only a prefix of the input and records that
+   may continue past it are left alone. Returns where the next call has to
+   resume, or NULL on allocation failure, in which case the list has been
+   freed. */
+const char *parse_entries_chunk(EntryList *list, const char *text, size_t len, int at_eof);
+
+/* Parses cleaned text into a new list, returns 0 on failure. */
+int parse_entries(const char *text, size_t len, EntryList *list);
+
+/* Same result as parse_entries, computed on thread_count threads. */
+int parse_entries_parallel(const char *text, size_t len, EntryList *list, int thread_count);
+
+/* Reads fp in fixed-size chunks, stripping and parsing as it goes, into a
+   new list that owns copies of its records. Also fills the byte counters.
+   Returns 0 on failure. */
+int stream_and_parse(FILE *fp, EntryList *list);
+
+/* Writes entries to ordered (room for count) by position, keeping the
+   original order inside each position. */
+void order_entries_into(const Entry *entries, size_t count, Entry *ordered);
+
+/* Orders entries into a new array and frees the input one. Returns NULL on
+   allocation failure, in which case the input is left untouched. */
+Entry *order_entries(Entry *entries, size_t count);
+
+/* Runs fn on every job of an array, one thread each (the last one on the
+   calling thread). */
+int run_parallel(void *(*fn)(void *), void *jobs, size_t job_size, int count);
+
+#endif // CLEANER_H
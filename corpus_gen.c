@@ -0,0 +1,168 @@
+#include <stdlib.h>
+#include <string.h>
+#include "corpus_gen.h"
+
+// Corruption runs before a byte are at most this long
+#define MAX_CORRUPTION_RUN 4
+
+static const char corruption[] = "#?!@&$";
+static const char alnum[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+static const char *const positions[] = {
+    "Boss", "Right Hand", "Left Hand", "Support_Right", "Support_Left"
+};
+
+// xorshift64*, so every platform generates the same bytes
+static uint64_t next_random(CorpusGen *gen) {
+    gen->state ^= gen->state >> 12;
+    gen->state ^= gen->state << 25;
+    gen->state ^= gen->state >> 27;
+    return gen->state * 2685821657736338717ULL;
+}
+
+static int chance(CorpusGen *gen, int percent) {
+    return percent > 0 && (int)(next_random(gen) % 100) < percent;
+}
+
+// Append one byte of clean text, maybe after a run of corruption
+static char *put_byte(CorpusGen *gen, char *out, char c) {
+    for (int i = 0; i < MAX_CORRUPTION_RUN && chance(gen, gen->params.corruption_percent); i++) {
+        *out++ = corruption[next_random(gen) % (sizeof(corruption) - 1)];
+    }
+    *out++ = c;
+    return out;
+}
+
+static char *put_text(CorpusGen *gen, char *out, const char *text, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        out = put_byte(gen, out, text[i]);
+    }
+    return out;
+}
+
+// Append a label such as "First Name:", maybe with whitespace inside it
+static char *put_label(CorpusGen *gen, char *out, const char *label) {
+    size_t len = strlen(label);
+    size_t split = len;
+    if (chance(gen, gen->params.label_space_percent)) {
+        split = 1 + next_random(gen) % (len - 1);
+    }
+    out = put_text(gen, out, label, split);
+    if (split < len) {
+        static const char spaces[] = " \t\n";
+        out = put_byte(gen, out, spaces[next_random(gen) % 3]);
+        out = put_text(gen, out, label + split, len - split);
+    }
+    return out;
+}
+
+// Append a capitalized name of 3 to 12 letters
+static char *put_name(CorpusGen *gen, char *out) {
+    size_t len = 3 + next_random(gen) % 10;
+    for (size_t i = 0; i < len; i++) {
+        char c = (char)('a' + next_random(gen) % 26);
+        out = put_byte(gen, out, i == 0 ? (char)(c - 'a' + 'A') : c);
+    }
+    return out;
+}
+
+static char *put_record(CorpusGen *gen, char *out) {
+    const CorpusParams *params = &gen->params;
+    
+    out = put_label(gen, out, "First Name:");
+    out = put_byte(gen, out, ' ');
+    out = put_name(gen, out);
+    out = put_byte(gen, out, '\n');
+    
+    out = put_label(gen, out, "Second Name:");
+    out = put_byte(gen, out, ' ');
+    out = put_name(gen, out);
+    out = put_byte(gen, out, '\n');
+    
+    char fingerprint[FINGERPRINT_LEN];
+    size_t fp_len = FINGERPRINT_LEN;
+    if (gen->recent_count > 0 && chance(gen, params->duplicate_percent)) {
+        size_t limit = gen->recent_count < CORPUS_RECENT ? gen->recent_count : CORPUS_RECENT;
+        memcpy(fingerprint, gen->recent[next_random(gen) % limit], FINGERPRINT_LEN);
+    } else {
+        for (int i = 0; i < FINGERPRINT_LEN; i++) {
+            fingerprint[i] = alnum[next_random(gen) % (sizeof(alnum) - 1)];
+        }
+        memcpy(gen->recent[gen->recent_count % CORPUS_RECENT], fingerprint, FINGERPRINT_LEN);
+        gen->recent_count++;
+    }
+    if (chance(gen, params->bad_fingerprint_percent)) {
+        fp_len = 4 + next_random(gen) % (FINGERPRINT_LEN - 4);
+    }
+    out = put_label(gen, out, "Fingerprint:");
+    out = put_byte(gen, out, ' ');
+    out = put_text(gen, out, fingerprint, fp_len);
+    out = put_byte(gen, out, '\n');
+    
+    const char *position = positions[next_random(gen) % 5];
+    out = put_label(gen, out, "Position:");
+    out = put_byte(gen, out, ' ');
+    out = put_text(gen, out, position, strlen(position));
+    out = put_byte(gen, out, '\n');
+    return put_byte(gen, out, '\n');
+}
+
+void corpus_default_params(CorpusParams *params, uint64_t seed) {
+    params->seed = seed;
+    params->records = 1000;
+    params->corruption_percent = 0;
+    params->label_space_percent = 0;
+    params->duplicate_percent = 0;
+    params->bad_fingerprint_percent = 0;
+}
+
+void corpus_init(CorpusGen *gen, const CorpusParams *params) {
+    gen->params = *params;
+    // xorshift must not start at zero
+    gen->state = params->seed * 0x9E3779B97F4A7C15ULL + 1;
+    gen->emitted = 0;
+    gen->recent_count = 0;
+}
+
+size_t corpus_next(CorpusGen *gen, char *buf, size_t capacity) {
+    char *out = buf;
+    while (gen->emitted < gen->params.records &&
+           (size_t)(out - buf) + CORPUS_MAX_RECORD <= capacity) {
+        out = put_record(gen, out);
+        gen->emitted++;
+    }
+    return (size_t)(out - buf);
+}
+
+char *corpus_generate(const CorpusParams *params, size_t *len) {
+    CorpusGen *gen = (CorpusGen *)malloc(sizeof(CorpusGen));
+    size_t capacity = 64 * 1024;
+    char *buffer = (char *)malloc(capacity);
+    if (gen == NULL || buffer == NULL) {
+        free(gen);
+        free(buffer);
+        return NULL;
+    }
+    corpus_init(gen, params);
+    
+    size_t length = 0;
+    for (;;) {
+        if (capacity - length < CORPUS_MAX_RECORD + 1) {
+            capacity *= 2;
+            char *temp = (char *)realloc(buffer, capacity);
+            if (temp == NULL) {
+                free(gen);
+                free(buffer);
+                return NULL;
+            }
+            buffer = temp;
+        }
+        size_t n = corpus_next(gen, buffer + length, capacity - length - 1);
+        if (n == 0) break;
+        length += n;
+    }
+    buffer[length] = '\0';
+    
+    free(gen);
+    *len = length;
+    return buffer;
+}
@@ -0,0 +1,48 @@
+#ifndef CORPUS_GEN_H
+#define CORPUS_GEN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "fingerprint.h"
+
+/* Largest number of bytes one generated record can take. */
+#define CORPUS_MAX_RECORD 4096
+
+/* How many recent fingerprints duplicates are drawn from. */
+#define CORPUS_RECENT 256
+
+/* Shape of a synthetic corrupted org dump. Percentages are 0..100. */
+typedef struct {
+    uint64_t seed;
+    size_t records;
+    int corruption_percent;         /* chance of corruption before each byte */
+    int label_space_percent;        /* chance of whitespace inside a label */
+    int duplicate_percent;          /* chance of reusing an earlier fingerprint */
+    int bad_fingerprint_percent;    /* chance of a too short fingerprint */
+} CorpusParams;
+
+/* Generator state; the same parameters always give the same bytes. */
+typedef struct {
+    CorpusParams params;
+    uint64_t state;
+    size_t emitted;
+    char recent[CORPUS_RECENT][FINGERPRINT_LEN];  /* fingerprints to repeat */
+    size_t recent_count;
+} CorpusGen;
+
+/* Fills params with a clean 1000-record corpus and the given seed. */
+void corpus_default_params(CorpusParams *params, uint64_t seed);
+
+/* Starts generating the corpus described by params. */
+void corpus_init(CorpusGen *gen, const CorpusParams *params);
+
+/* Writes the next whole records into buf (capacity at least
+   CORPUS_MAX_RECORD). Returns the bytes written, 0 once every record is
+   out. */
+size_t corpus_next(CorpusGen *gen, char *buf, size_t capacity);
+
+/* Generates a whole corpus in memory. Returns a NUL-terminated buffer of
+   *len bytes, or NULL on allocation failure. */
+char *corpus_generate(const CorpusParams *params, size_t *len);
+
+#endif // CORPUS_GEN_H
@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "decrypt.h"
+
+// Helper function to check if a fingerprint AND mask matches cipher
+static int and_matches(const char *fingerprint, const unsigned char *cipher, int mask) {
+    for (int i = 0; i < FINGERPRINT_LEN; i++) {
+        if (((unsigned char)fingerprint[i] & (unsigned char)mask) != cipher[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Helper function to find the node whose fingerprint XOR mask matches
+// cipher. XOR undoes itself, so that fingerprint is cipher XOR mask and a
+// single index lookup finds it.
+static const Node *find_xor_match(const Org *org, const unsigned char *cipher, int mask) {
+    char fingerprint[FINGERPRINT_LEN];
+    for (int i = 0; i < FINGERPRINT_LEN; i++) {
+        fingerprint[i] = (char)(cipher[i] ^ (unsigned char)mask);
+    }
+    uint64_t key = pack_fingerprint(fingerprint);
+    return key != 0 ? org_find_by_fingerprint(org, key) : NULL;
+}
+
+// Helper function to lower *mask_end to the first mask from mask_start on
+// under which node AND-matches cipher; returns 1 if it did
+static int lower_and_mask(const Node *node, const unsigned char *cipher, int mask_start, int *mask_end) {
+    if (node == NULL) return 0;
+    
+    char fingerprint[FINGERPRINT_LEN + 1];
+    node_fingerprint(node, fingerprint);
+    for (int mask = mask_start; mask < *mask_end; mask++) {
+        if (and_matches(fingerprint, cipher, mask)) {
+            *mask_end = mask;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Helper function to find the lowest mask below *mask_end under which some
+// node AND-matches cipher. AND loses bits and cannot be looked up, so the
+// tree is walked once, in tree order, trying every mask on each node; only
+// a strictly lower mask replaces the current best, so for a given mask the
+// first node in tree order wins.
+static const Node *find_and_match(const Org *org, const unsigned char *cipher, int mask_start, int *mask_end) {
+    const Node *best = NULL;
+    const Node *hands[2] = { org->left_hand, org->right_hand };
+    
+    if (lower_and_mask(org->boss, cipher, mask_start, mask_end)) {
+        best = org->boss;
+    }
+    for (int h = 0; h < 2 && *mask_end > mask_start; h++) {
+        const Node *hand = hands[h];
+        if (hand == NULL) continue;
+        
+        if (lower_and_mask(hand, cipher, mask_start, mask_end)) {
+            best = hand;
+        }
+        for (size_t i = 0; i < hand->support_count && *mask_end > mask_start; i++) {
+            if (lower_and_mask(hand->supports[i], cipher, mask_start, mask_end)) {
+                best = hand->supports[i];
+            }
+        }
+    }
+    return best;
+}
+
+int read_cipher_file(const char *path, unsigned char *cipher) {
+    FILE *cipher_file = fopen(path, "r");
+    if (cipher_file == NULL) {
+        printf("Error opening file: %s\n", path);
+        return 0;
+    }
+    
+    // Read 9 lines of 8-bit binary numbers
+    char line[16];
+    for (int i = 0; i < FINGERPRINT_LEN; i++) {
+        if (fgets(line, sizeof(line), cipher_file) == NULL) {
+            printf("Error reading cipher file\n");
+            fclose(cipher_file);
+            return 0;
+        }
+        
+        // Convert binary string to byte
+        cipher[i] = 0;
+        for (int j = 0; j < 8 && line[j] != '\0' && line[j] != '\n'; j++) {
+            cipher[i] = (cipher[i] << 1) | (line[j] - '0');
+        }
+    }
+    fclose(cipher_file);
+    return 1;
+}
+
+int find_decrypt_match(const Org *org, const unsigned char *cipher, int mask_start, DecryptMatch *match) {
+    int mask_end = mask_start + DECRYPT_MASK_RANGE + 1;
+    
+    // Try XOR, one lookup per mask, up to the first hit
+    const Node *xor_node = NULL;
+    int xor_mask = mask_end;
+    for (int mask = mask_start; mask < mask_end; mask++) {
+        xor_node = find_xor_match(org, cipher, mask);
+        if (xor_node != NULL) {
+            xor_mask = mask;
+            break;
+        }
+    }
+    
+    // Try AND, only below the XOR hit since XOR is tried first for a mask
+    int and_mask = xor_mask;
+    const Node *and_node = find_and_match(org, cipher, mask_start, &and_mask);
+    if (and_node != NULL) {
+        match->node = and_node;
+        match->mask = and_mask;
+        match->operation = "AND";
+        return 1;
+    }
+    
+    if (xor_node != NULL) {
+        match->node = xor_node;
+        match->mask = xor_mask;
+        match->operation = "XOR";
+        return 1;
+    }
+    return 0;
+}
+
+void print_decrypt_result(const DecryptMatch *match) {
+    if (match == NULL) {
+        printf("Unsuccesful decrypt, Looks like he got away\n");
+        return;
+    }
+    char fingerprint[FINGERPRINT_LEN + 1];
+    node_fingerprint(match->node, fingerprint);
+    printf("Successful Decrypt! The Mask used was mask_%d of type (%s) and The fingerprint was %s belonging to %s %s\n",
+           match->mask, match->operation, fingerprint,
+           match->node->first, match->node->second);
+}
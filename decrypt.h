@@ -0,0 +1,31 @@
+#ifndef DECRYPT_H
+#define DECRYPT_H
+
+#include "org_tree.h"
+#include "fingerprint.h"
+
+/* How many masks are tried after the starting one. */
+#define DECRYPT_MASK_RANGE 10
+
+/* The node whose fingerprint encrypts to the cipher, and how. */
+typedef struct {
+    const Node *node;
+    int mask;
+    const char *operation;  /* "XOR" or "AND" */
+} DecryptMatch;
+
+/* Reads the cipher file: FINGERPRINT_LEN lines of 8 binary digits. Returns 0
+   (after printing the error) if it cannot be opened or is too short. */
+int read_cipher_file(const char *path, unsigned char *cipher);
+
+/* Tries the masks mask_start .. mask_start + DECRYPT_MASK_RANGE in order,
+   XOR before AND for each, on every node in tree order. Returns 1 and fills
+   match at the first hit, 0 if there is none. XOR is looked up in the Org's
+   fingerprint index (see org_find_by_fingerprint); AND needs one walk of
+   the tree, cut short by an XOR hit at the first mask. */
+int find_decrypt_match(const Org *org, const unsigned char *cipher, int mask_start, DecryptMatch *match);
+
+/* Prints the ex2 verdict: the match, or NULL for a failed decrypt. */
+void print_decrypt_result(const DecryptMatch *match);
+
+#endif // DECRYPT_H
@@ -0,0 +1,44 @@
+#ifndef ENTRY_H
+#define ENTRY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Position hierarchy for sorting. */
+typedef enum {
+    BOSS = 0,
+    RIGHT_HAND = 1,
+    LEFT_HAND = 2,
+    SUPPORT_RIGHT = 3,
+    SUPPORT_LEFT = 4,
+    UNKNOWN = 5
+} PositionType;
+
+#define POSITION_TYPE_COUNT 6
+
+/* One parsed record, as a view into the text it was parsed from. The first
+   name starts at text; the second name and position are further slices of
+   the same span. Values are trimmed but may still contain newlines, which
+   are dropped when the record is written. The position text is only needed
+   for UNKNOWN positions; the other five are written from pos_type. */
+typedef struct {
+    const char *text;
+    uint64_t fingerprint;       /* packed, see fingerprint.h */
+    uint32_t first_len;
+    uint32_t second_offset;
+    uint32_t second_len;
+    uint32_t position_offset;
+    uint32_t position_len;
+    uint8_t pos_type;           /* PositionType */
+    size_t original_order;
+} Entry;
+
+/* Output name of a known position type, NULL for UNKNOWN. */
+static inline const char *position_name(PositionType type) {
+    static const char *const names[POSITION_TYPE_COUNT] = {
+        "Boss", "Right Hand", "Left Hand", "Support_Right", "Support_Left", NULL
+    };
+    return names[type];
+}
+
+#endif // ENTRY_H
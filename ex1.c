@@ -1,414 +1,866 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
-
-#define FINGERPRINT_LEN 9
-
-// Position hierarchy for sorting
-typedef enum {
-    BOSS = 0,
-    RIGHT_HAND = 1,
-    LEFT_HAND = 2,
-    SUPPORT_RIGHT = 3,
-    SUPPORT_LEFT = 4,
-    UNKNOWN = 5
-} PositionType;
-
-// Entry structure
-typedef struct {
-    char *first_name;
-    char *second_name;
-    char fingerprint[FINGERPRINT_LEN + 1];
-    char *position;
-    PositionType pos_type;
-    int original_order;
-} Entry;
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <time.h>
+#include "cleaner.h"
+#include "strip.h"
+#include "file_map.h"
+#include "record_writer.h"
+#include "clean_binary.h"
+#include "clean_merge.h"
 
 //TODO create functions that you can use to clean up the file
 
-// Remove corruption characters from a character
-int is_corruption(char c) {
-    return (c == '#' || c == '?' || c == '!' || c == '@' || c == '&' || c == '$');
-}
-
-// Get position type from string
-PositionType get_position_type(const char *pos) {
-    if (strcmp(pos, "Boss") == 0) return BOSS;
-    if (strcmp(pos, "Right Hand") == 0) return RIGHT_HAND;
-    if (strcmp(pos, "Left Hand") == 0) return LEFT_HAND;
-    if (strcmp(pos, "Support_Right") == 0) return SUPPORT_RIGHT;
-    if (strcmp(pos, "Support_Left") == 0) return SUPPORT_LEFT;
-    return UNKNOWN;
-}
-
-// Compare function for qsort
-int compare_entries(const void *a, const void *b) {
-    Entry *e1 = (Entry *)a;
-    Entry *e2 = (Entry *)b;
+// Read a file and remove corruption into *buffer, growing it (and
+// *capacity) when the cleaned text does not fit. Returns the cleaned length,
+// or (size_t)-1 on failure; *input_size (if not NULL) gets the file size.
+// The input is memory-mapped where possible, so the only full-size buffer
+// is the cleaned copy.
+size_t clean_file_into(const char *path, char **buffer, size_t *capacity, size_t *input_size) {
+    MappedFile input;
+    if (!map_file(path, &input)) {
+        printf("Error opening file: %s\n", path);
+        return (size_t)-1;
+    }
+    if (input_size != NULL) {
+        *input_size = input.size;
+    }
     
-    if (e1->pos_type != e2->pos_type) {
-        return e1->pos_type - e2->pos_type;
+    if (*buffer == NULL || *capacity < input.size + 1) {
+        char *temp = *buffer == NULL ? (char *)alloc_huge_buffer(input.size + 1)
+                                     : (char *)realloc(*buffer, input.size + 1);
+        if (temp == NULL) {
+            printf("Memory allocation failed\n");
+            unmap_file(&input);
+            return (size_t)-1;
+        }
+        *buffer = temp;
+        *capacity = input.size + 1;
     }
     
-    return e1->original_order - e2->original_order;
+    size_t j = strip_corruption(input.data, input.size, *buffer);
+    (*buffer)[j] = '\0';
+    
+    unmap_file(&input);
+    return j;
 }
 
-// Check if fingerprint already exists
-int is_duplicate(Entry *entries, int count, const char *fingerprint) {
-    for (int i = 0; i < count; i++) {
-        if (strcmp(entries[i].fingerprint, fingerprint) == 0) {
-            return 1;
-        }
+// Read entire file and remove corruption, returning cleaned string. The
+// sizes before and after cleaning go to *input_size and *cleaned_len.
+char* read_and_clean_file(const char *path, size_t *input_size, size_t *cleaned_len) {
+    char *cleaned = NULL;
+    size_t capacity = 0;
+    *cleaned_len = clean_file_into(path, &cleaned, &capacity, input_size);
+    if (*cleaned_len == (size_t)-1) {
+        free(cleaned);
+        return NULL;
     }
-    return 0;
+    return cleaned;
 }
 
-// Free a single entry
-void free_entry(Entry *entry) {
-    if (entry->first_name) free(entry->first_name);
-    if (entry->second_name) free(entry->second_name);
-    if (entry->position) free(entry->position);
-}
+// ---- Batch mode ------------------------------------------------------------
+//
+// Cleans many files in one process. Each worker takes the next input from a
+// shared queue and keeps its buffers from one file to the next: the cleaned
+// text, the entry list with its fingerprint set and label list, the ordering
+// scratch and the output buffer. Once they have grown, a small file costs no
+// allocations. Outputs are named after their inputs; of two inputs with the
+// same file name, the one handled last wins.
 
-// Free all entries
-void free_entries(Entry *entries, int count) {
-    for (int i = 0; i < count; i++) {
-        free_entry(&entries[i]);
-    }
-    free(entries);
-}
+typedef struct {
+    char **inputs;
+    size_t count;
+    const char *out_dir;
+    size_t next;            // next input to hand out
+    size_t cleaned;         // inputs written successfully
+    pthread_mutex_t lock;
+} BatchQueue;
+
+typedef struct {
+    BatchQueue *queue;
+    char *text;
+    size_t text_capacity;
+    EntryList list;
+    Entry *ordered;
+    size_t ordered_capacity;
+    RecordWriter writer;
+    int ready;              // buffers set up
+} BatchWorker;
 
-// Read entire file and remove corruption, returning cleaned string
-char* read_and_clean_file(FILE *fp) {
-    fseek(fp, 0, SEEK_END);
-    long file_size = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
-    
-    char *buffer = (char *)malloc(file_size + 1);
-    if (buffer == NULL) {
+// Output path for input: out_dir plus the input's file name. Returns a new
+// string, or NULL on allocation failure.
+char* batch_output_path(const char *out_dir, const char *input) {
+    const char *name = input;
+    for (const char *p = input; *p != '\0'; p++) {
+        if (*p == '/' || *p == '\\') name = p + 1;
+    }
+    size_t dir_len = strlen(out_dir);
+    char *path = (char *)malloc(dir_len + strlen(name) + 2);
+    if (path == NULL) {
         printf("Memory allocation failed\n");
         return NULL;
     }
+    sprintf(path, "%s/%s", out_dir, name);
+    return path;
+}
+
+// Clean one input into output with the worker's buffers, returns 0 on failure
+int batch_clean_file(BatchWorker *worker, const char *input, const char *output) {
+    size_t text_len = clean_file_into(input, &worker->text, &worker->text_capacity, NULL);
+    if (text_len == (size_t)-1) {
+        return 0;
+    }
     
-    fread(buffer, 1, file_size, fp);
-    buffer[file_size] = '\0';
-    
-    char *cleaned = (char *)malloc(file_size + 1);
-    if (cleaned == NULL) {
-        printf("Memory allocation failed\n");
-        free(buffer);
-        return NULL;
+    reset_entry_list(&worker->list);
+    if (parse_entries_chunk(&worker->list, worker->text, text_len, 1) == NULL) {
+        // The list was freed; the worker needs a new one for its next file
+        worker->ready = init_entry_list(&worker->list);
+        return 0;
     }
     
-    int j = 0;
-    for (long i = 0; i < file_size; i++) {
-        if (!is_corruption(buffer[i])) {
-            cleaned[j++] = buffer[i];
+    EntryList *list = &worker->list;
+    if (list->count > worker->ordered_capacity) {
+        Entry *temp = (Entry *)realloc(worker->ordered, list->capacity * sizeof(Entry));
+        if (temp == NULL) {
+            printf("Memory allocation failed\n");
+            return 0;
         }
+        worker->ordered = temp;
+        worker->ordered_capacity = list->capacity;
     }
-    cleaned[j] = '\0';
+    order_entries_into(list->entries, list->count, worker->ordered);
     
-    free(buffer);
-    return cleaned;
+    FILE *fp = fopen(output, "w");
+    if (fp == NULL) {
+        printf("Error opening file: %s\n", output);
+        return 0;
+    }
+    record_writer_set_file(&worker->writer, fp);
+    for (size_t i = 0; i < list->count; i++) {
+        record_writer_put(&worker->writer, &worker->ordered[i]);
+    }
+    int ok = record_writer_flush(&worker->writer);
+    if (fclose(fp) != 0) ok = 0;
+    if (!ok) {
+        printf("Error writing file: %s\n", output);
+    }
+    return ok;
 }
 
-// Find a pattern in text, ignoring whitespace within the pattern
-// Returns pointer to start of match in text
-const char* find_label(const char *text, const char *pattern) {
-    const char *t = text;
-    
-    while (*t != '\0') {
-        const char *t_check = t;
-        const char *p = pattern;
-        int matched = 1;
+void *batch_worker(void *arg) {
+    BatchWorker *worker = (BatchWorker *)arg;
+    BatchQueue *queue = worker->queue;
+    
+    while (worker->ready) {
+        pthread_mutex_lock(&queue->lock);
+        size_t index = queue->next;
+        if (index < queue->count) queue->next++;
+        pthread_mutex_unlock(&queue->lock);
+        if (index >= queue->count) break;
         
-        // Try to match pattern from this position
-        while (*p != '\0') {
-            // Skip whitespace in text
-            while (*t_check != '\0' && (*t_check == ' ' || *t_check == '\t' || 
-                   *t_check == '\n' || *t_check == '\r')) {
-                t_check++;
-            }
-            
-            if (*t_check != *p) {
-                matched = 0;
-                break;
-            }
-            
-            t_check++;
-            p++;
-        }
+        char *output = batch_output_path(queue->out_dir, queue->inputs[index]);
+        int ok = output != NULL && batch_clean_file(worker, queue->inputs[index], output);
+        free(output);
         
-        if (matched) {
-            return t;
+        if (ok) {
+            pthread_mutex_lock(&queue->lock);
+            queue->cleaned++;
+            pthread_mutex_unlock(&queue->lock);
         }
-        
-        t++;
     }
-    
     return NULL;
 }
 
-// Skip past a label (including any whitespace within it)
-const char* skip_label(const char *text, const char *pattern) {
-    const char *t = text;
-    const char *p = pattern;
-    
-    while (*p != '\0') {
-        // Skip whitespace in text
-        while (*t != '\0' && (*t == ' ' || *t == '\t' || *t == '\n' || *t == '\r')) {
-            t++;
-        }
-        
-        if (*t != *p) {
-            return text; // Shouldn't happen if find_label was called first
-        }
-        
-        t++;
-        p++;
+// Append a copy of path to the input list, returns 0 on allocation failure
+int add_batch_input(char ***inputs, size_t *count, size_t *capacity, const char *path) {
+    if (*count == *capacity) {
+        size_t new_capacity = *capacity ? *capacity * 2 : 16;
+        char **temp = (char **)realloc(*inputs, new_capacity * sizeof(char *));
+        if (temp == NULL) return 0;
+        *inputs = temp;
+        *capacity = new_capacity;
     }
-    
-    return t;
+    char *copy = (char *)malloc(strlen(path) + 1);
+    if (copy == NULL) return 0;
+    strcpy(copy, path);
+    (*inputs)[(*count)++] = copy;
+    return 1;
 }
 
-// Extract value between current position and next label
-// Removes newlines, keeps spaces
-char* extract_value_to_label(const char *start, const char *end) {
-    // Skip leading whitespace
-    while (start < end && (*start == ' ' || *start == '\t' || *start == '\n' || *start == '\r')) {
-        start++;
+int compare_paths(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+void free_batch_inputs(char **inputs, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        free(inputs[i]);
     }
-    
-    // Skip trailing whitespace
-    while (end > start && (*(end - 1) == ' ' || *(end - 1) == '\t' || 
-           *(end - 1) == '\n' || *(end - 1) == '\r')) {
-        end--;
+    free(inputs);
+}
+
+// List the inputs named by source: every regular file of a directory (in
+// name order, hidden files skipped), or every non-empty line of a manifest.
+// Returns 0 on failure.
+int collect_batch_inputs(const char *source, char ***inputs, size_t *count) {
+    size_t capacity = 0;
+    *inputs = NULL;
+    *count = 0;
+    
+    struct stat info;
+    if (stat(source, &info) != 0) {
+        printf("Error opening file: %s\n", source);
+        return 0;
     }
     
-    if (end <= start) {
-        char *result = (char *)malloc(1);
-        if (result) result[0] = '\0';
-        return result;
+    if (S_ISDIR(info.st_mode)) {
+        DIR *dir = opendir(source);
+        if (dir == NULL) {
+            printf("Error opening file: %s\n", source);
+            return 0;
+        }
+        struct dirent *item;
+        while ((item = readdir(dir)) != NULL) {
+            if (item->d_name[0] == '.') continue;
+            char *path = batch_output_path(source, item->d_name);
+            if (path == NULL) {
+                closedir(dir);
+                free_batch_inputs(*inputs, *count);
+                return 0;
+            }
+            int ok = 1;
+            if (stat(path, &info) == 0 && S_ISREG(info.st_mode)) {
+                ok = add_batch_input(inputs, count, &capacity, path);
+            }
+            free(path);
+            if (!ok) {
+                printf("Memory allocation failed\n");
+                closedir(dir);
+                free_batch_inputs(*inputs, *count);
+                return 0;
+            }
+        }
+        closedir(dir);
+        qsort(*inputs, *count, sizeof(char *), compare_paths);
+        return 1;
     }
     
-    // Count characters (excluding newlines)
-    int len = 0;
-    for (const char *p = start; p < end; p++) {
-        if (*p != '\n' && *p != '\r') {
-            len++;
+    FILE *manifest = fopen(source, "r");
+    if (manifest == NULL) {
+        printf("Error opening file: %s\n", source);
+        return 0;
+    }
+    char line[4096];
+    while (fgets(line, sizeof(line), manifest) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0') continue;
+        if (!add_batch_input(inputs, count, &capacity, line)) {
+            printf("Memory allocation failed\n");
+            fclose(manifest);
+            free_batch_inputs(*inputs, *count);
+            return 0;
         }
     }
+    fclose(manifest);
+    return 1;
+}
+
+// Clean every input named by source into out_dir on worker_count threads
+void run_batch(const char *source, const char *out_dir, int worker_count) {
+    BatchQueue queue;
+    if (!collect_batch_inputs(source, &queue.inputs, &queue.count)) {
+        return;
+    }
+    queue.out_dir = out_dir;
+    queue.next = 0;
+    queue.cleaned = 0;
+    pthread_mutex_init(&queue.lock, NULL);
     
-    char *result = (char *)malloc(len + 1);
-    if (result == NULL) {
+    if ((size_t)worker_count > queue.count) {
+        worker_count = queue.count > 0 ? (int)queue.count : 1;
+    }
+    BatchWorker *workers = (BatchWorker *)calloc(worker_count, sizeof(BatchWorker));
+    if (workers == NULL) {
         printf("Memory allocation failed\n");
-        return NULL;
+        pthread_mutex_destroy(&queue.lock);
+        free_batch_inputs(queue.inputs, queue.count);
+        return;
     }
+    for (int i = 0; i < worker_count; i++) {
+        workers[i].queue = &queue;
+        workers[i].ready = init_entry_list(&workers[i].list);
+        if (workers[i].ready && !record_writer_init(&workers[i].writer, NULL, RECORD_WRITER_BUFFER_SIZE)) {
+            printf("Memory allocation failed\n");
+            free_entry_list(&workers[i].list);
+            workers[i].ready = 0;
+        }
+    }
+    
+    run_parallel(batch_worker, workers, sizeof(BatchWorker), worker_count);
     
-    // Copy, skipping newlines
-    int j = 0;
-    for (const char *p = start; p < end; p++) {
-        if (*p != '\n' && *p != '\r') {
-            result[j++] = *p;
+    for (int i = 0; i < worker_count; i++) {
+        if (workers[i].ready) {
+            free_entry_list(&workers[i].list);
         }
+        record_writer_close(&workers[i].writer);
+        free(workers[i].text);
+        free(workers[i].ordered);
+    }
+    if (queue.cleaned < queue.count) {
+        printf("Cleaned %zu of %zu files\n", queue.cleaned, queue.count);
     }
-    result[j] = '\0';
     
-    return result;
+    free(workers);
+    pthread_mutex_destroy(&queue.lock);
+    free_batch_inputs(queue.inputs, queue.count);
 }
 
-// Parse entries from cleaned text
-Entry* parse_entries(const char *text, int *entry_count) {
-    *entry_count = 0;
-    int capacity = 10;
-    int order_counter = 0;
-    
-    Entry *entries = (Entry *)malloc(capacity * sizeof(Entry));
-    if (entries == NULL) {
+// ---- Incremental mode ------------------------------------------------------
+//
+// For append-only inputs. <output>.state remembers how far the input has been
+// parsed and what is needed to carry on from there: the raw byte offset where
+// the unfinished tail starts, the fingerprints accepted before it, the order
+// counter and the byte length of every position bucket in the output. A later
+// run strips and parses only the bytes past the offset, then rebuilds the
+// output by copying each old bucket and appending the new records of that
+// position, which gives the same file as a full run.
+//
+// The tail is parsed like a streaming chunk: records that more appended text
+// could still change (the last one, typically) are written but not
+// committed. The offset stays before them and their bytes are dropped from
+// the old output, so the next run parses them again.
+// Assumes appends only ever add bytes at the end of the input.
+
+#define STATE_MAGIC "EX1STATE"
+#define STATE_VERSION 1
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t input_offset;                          // raw bytes committed
+    uint64_t order_counter;
+    uint64_t output_size;
+    uint64_t committed_len[POSITION_TYPE_COUNT];    // bytes of committed records
+    uint64_t pending_len[POSITION_TYPE_COUNT];      // uncommitted bytes after them
+    uint64_t fingerprint_count;                     // keys following the header
+} IncrementalState;
+
+// Path of a file next to path, returns a new string or NULL
+char* sidecar_path(const char *path, const char *suffix) {
+    char *sidecar = (char *)malloc(strlen(path) + strlen(suffix) + 1);
+    if (sidecar == NULL) {
         printf("Memory allocation failed\n");
         return NULL;
     }
-    
-    const char *ptr = text;
-    
-    while (*ptr != '\0') {
-        // Look for "FirstName:" (ignoring whitespace)
-        const char *first_name_start = find_label(ptr, "FirstName:");
-        if (first_name_start == NULL) break;
-        
-        // Skip past the label
-        ptr = skip_label(first_name_start, "FirstName:");
-        
-        // Find "SecondName:"
-        const char *second_name_start = find_label(ptr, "SecondName:");
-        if (second_name_start == NULL) break;
-        
-        // Extract first name
-        char *first_name = extract_value_to_label(ptr, second_name_start);
-        if (first_name == NULL) {
-            free_entries(entries, *entry_count);
-            return NULL;
-        }
-        
-        // Skip past "SecondName:"
-        ptr = skip_label(second_name_start, "SecondName:");
-        
-        // Find "Fingerprint:"
-        const char *fingerprint_start = find_label(ptr, "Fingerprint:");
-        if (fingerprint_start == NULL) {
-            free(first_name);
+    sprintf(sidecar, "%s%s", path, suffix);
+    return sidecar;
+}
+
+// Load a state file and its fingerprints into seen. Returns 0 if there is
+// no usable state, in which case the run starts from the beginning.
+int load_state(const char *path, IncrementalState *state, FpSet *seen) {
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return 0;
+    }
+    int ok = fread(state, sizeof(*state), 1, fp) == 1 &&
+             memcmp(state->magic, STATE_MAGIC, sizeof(state->magic)) == 0 &&
+             state->version == STATE_VERSION;
+    
+    uint64_t keys[1024];
+    uint64_t left = ok ? state->fingerprint_count : 0;
+    while (ok && left > 0) {
+        size_t want = left < 1024 ? (size_t)left : 1024;
+        if (fread(keys, sizeof(uint64_t), want, fp) != want) {
+            ok = 0;
             break;
         }
-        
-        // Extract second name
-        char *second_name = extract_value_to_label(ptr, fingerprint_start);
-        if (second_name == NULL) {
-            free(first_name);
-            free_entries(entries, *entry_count);
-            return NULL;
+        for (size_t i = 0; i < want && ok; i++) {
+            ok = fp_set_insert(seen, keys[i]) >= 0;
         }
-        
-        // Skip past "Fingerprint:"
-        ptr = skip_label(fingerprint_start, "Fingerprint:");
-        
-        // Skip whitespace before fingerprint
-        while (*ptr == ' ' || *ptr == '\t' || *ptr == '\n' || *ptr == '\r') ptr++;
-        
-        // Extract fingerprint (exactly 9 alphanumeric characters)
-        char fingerprint[FINGERPRINT_LEN + 1];
-        int fp_len = 0;
-        while (fp_len < FINGERPRINT_LEN && isalnum(*ptr)) {
-            fingerprint[fp_len++] = *ptr++;
+        left -= want;
+    }
+    fclose(fp);
+    
+    if (!ok) {
+        printf("Ignoring unreadable state file: %s\n", path);
+        fp_set_clear(seen);
+    }
+    return ok;
+}
+
+// Write the state and its fingerprints, returns 0 on failure
+int save_state(const char *path, const IncrementalState *state, const uint64_t *keys) {
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL) {
+        printf("Error opening file: %s\n", path);
+        return 0;
+    }
+    int ok = fwrite(state, sizeof(*state), 1, fp) == 1 &&
+             fwrite(keys, sizeof(uint64_t), (size_t)state->fingerprint_count, fp) == state->fingerprint_count;
+    if (fclose(fp) != 0) ok = 0;
+    if (!ok) {
+        printf("Error writing file: %s\n", path);
+        remove(path);
+    }
+    return ok;
+}
+
+// Raw offset in src of the byte that is cleaned[cleaned_offset], where
+// cleaned is src with the corruption stripped
+size_t raw_offset_of(const char *src, size_t len, size_t cleaned_offset) {
+    size_t kept = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (is_corruption(src[i])) continue;
+        if (kept == cleaned_offset) return i;
+        kept++;
+    }
+    return len;
+}
+
+// Write the merged output to path: per position, the old committed bytes,
+// then the new committed records, then the new uncommitted ones. ordered
+// holds the committed records and then the uncommitted ones, each part
+// sorted by position. Updates the bucket lengths in state.
+int write_incremental_output(const char *path, const MappedFile *old_output, IncrementalState *state,
+                             const Entry *ordered, size_t committed, size_t count) {
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL) {
+        printf("Error opening file: %s\n", path);
+        return 0;
+    }
+    RecordWriter writer;
+    if (!record_writer_init(&writer, fp, RECORD_WRITER_BUFFER_SIZE)) {
+        printf("Memory allocation failed\n");
+        fclose(fp);
+        return 0;
+    }
+    
+    size_t old_start = 0;
+    size_t next_committed = 0;
+    size_t next_pending = committed;
+    for (int t = BOSS; t <= UNKNOWN; t++) {
+        size_t bucket_start = writer.written;
+        if (old_output != NULL) {
+            record_writer_put_bytes(&writer, old_output->data + old_start, (size_t)state->committed_len[t]);
+            old_start += (size_t)(state->committed_len[t] + state->pending_len[t]);
         }
-        fingerprint[fp_len] = '\0';
-        
-        if (fp_len != FINGERPRINT_LEN) {
-            free(first_name);
-            free(second_name);
-            continue;
+        while (next_committed < committed && ordered[next_committed].pos_type == t) {
+            record_writer_put(&writer, &ordered[next_committed++]);
         }
-        
-        // Find "Position:"
-        const char *position_start = find_label(ptr, "Position:");
-        if (position_start == NULL) {
-            free(first_name);
-            free(second_name);
-            break;
+        size_t pending_start = writer.written;
+        while (next_pending < count && ordered[next_pending].pos_type == t) {
+            record_writer_put(&writer, &ordered[next_pending++]);
         }
-        
-        // Skip past "Position:"
-        ptr = skip_label(position_start, "Position:");
-        
-        // Find next "FirstName:" or end of string
-        const char *next_entry = find_label(ptr, "FirstName:");
-        const char *position_end = next_entry ? next_entry : (ptr + strlen(ptr));
-        
-        // Extract position
-        char *position = extract_value_to_label(ptr, position_end);
-        if (position == NULL) {
-            free(first_name);
-            free(second_name);
-            free_entries(entries, *entry_count);
-            return NULL;
+        state->committed_len[t] = pending_start - bucket_start;
+        state->pending_len[t] = writer.written - pending_start;
+    }
+    state->output_size = writer.written;
+    
+    int ok = record_writer_close(&writer);
+    if (fclose(fp) != 0) ok = 0;
+    if (!ok) {
+        printf("Error writing file: %s\n", path);
+    }
+    return ok;
+}
+
+// Bring output up to date with everything appended to input since the last
+// incremental run
+void run_incremental(const char *input_path, const char *output_path) {
+    char *state_path = sidecar_path(output_path, ".state");
+    char *temp_path = sidecar_path(output_path, ".tmp");
+    EntryList list;
+    if (state_path == NULL || temp_path == NULL || !init_entry_list(&list)) {
+        free(state_path);
+        free(temp_path);
+        return;
+    }
+    
+    MappedFile input;
+    if (!map_file(input_path, &input)) {
+        printf("Error opening file: %s\n", input_path);
+        free_entry_list(&list);
+        free(state_path);
+        free(temp_path);
+        return;
+    }
+    
+    // The state only holds if the input grew and the output is untouched
+    IncrementalState state;
+    MappedFile old_output;
+    int have_state = load_state(state_path, &state, &list.seen);
+    int have_output = have_state && map_file(output_path, &old_output);
+    if (have_state && (!have_output || old_output.size != state.output_size ||
+                       input.size < state.input_offset)) {
+        printf("State does not match %s, starting over\n", output_path);
+        have_state = 0;
+        fp_set_clear(&list.seen);
+    }
+    if (!have_state) {
+        memset(&state, 0, sizeof(state));
+        memcpy(state.magic, STATE_MAGIC, sizeof(state.magic));
+        state.version = STATE_VERSION;
+    }
+    list.order_counter = (size_t)state.order_counter;
+    
+    // The text ends at the first NUL, like in a full run
+    const char *tail = input.data + state.input_offset;
+    size_t tail_len = input.size - (size_t)state.input_offset;
+    const char *nul = (const char *)memchr(tail, '\0', tail_len);
+    if (nul != NULL) {
+        tail_len = (size_t)(nul - tail);
+    }
+    
+    char *cleaned = (char *)alloc_huge_buffer(tail_len + 1);
+    if (cleaned == NULL) {
+        printf("Memory allocation failed\n");
+    }
+    uint64_t *keys = NULL;
+    Entry *ordered = NULL;
+    const char *resume = NULL;
+    size_t committed = 0;
+    int list_freed = 0;     // parse_entries_chunk frees the list when it fails
+    size_t cleaned_len = 0;
+    int ok = cleaned != NULL;
+    if (ok) {
+        cleaned_len = strip_corruption(tail, tail_len, cleaned);
+        cleaned[cleaned_len] = '\0';
+        resume = parse_entries_chunk(&list, cleaned, cleaned_len, 0);
+        ok = resume != NULL;
+        list_freed = !ok;
+    }
+    if (ok) {
+        // Commit what the next appended bytes cannot change
+        committed = list.count;
+        state.order_counter = (uint64_t)list.order_counter;
+        state.input_offset += raw_offset_of(tail, tail_len, (size_t)(resume - cleaned));
+        keys = (uint64_t *)malloc((list.seen.count + 1) * sizeof(uint64_t));
+        if (keys == NULL) {
+            printf("Memory allocation failed\n");
+            ok = 0;
         }
-        
-        // Check for duplicates
-        if (!is_duplicate(entries, *entry_count, fingerprint)) {
-            // Expand array if needed
-            if (*entry_count >= capacity) {
-                capacity *= 2;
-                Entry *temp = (Entry *)realloc(entries, capacity * sizeof(Entry));
-                if (temp == NULL) {
-                    printf("Memory allocation failed\n");
-                    free(first_name);
-                    free(second_name);
-                    free(position);
-                    free_entries(entries, *entry_count);
-                    return NULL;
-                }
-                entries = temp;
-            }
-            
-            // Add entry
-            entries[*entry_count].first_name = first_name;
-            entries[*entry_count].second_name = second_name;
-            strcpy(entries[*entry_count].fingerprint, fingerprint);
-            entries[*entry_count].position = position;
-            entries[*entry_count].pos_type = get_position_type(position);
-            entries[*entry_count].original_order = order_counter++;
-            (*entry_count)++;
-        } else {
-            // Duplicate found, free the strings
-            free(first_name);
-            free(second_name);
-            free(position);
+    }
+    if (ok) {
+        state.fingerprint_count = fp_set_keys(&list.seen, keys);
+        // The rest is written, but parsed again next time
+        ok = parse_entries_chunk(&list, resume, cleaned_len - (size_t)(resume - cleaned), 1) != NULL;
+        list_freed = !ok;
+    }
+    if (ok) {
+        ordered = (Entry *)malloc((list.count + 1) * sizeof(Entry));
+        if (ordered == NULL) {
+            printf("Memory allocation failed\n");
+            ok = 0;
         }
-        
-        // Move to next entry
-        if (next_entry) {
-            ptr = next_entry;
-        } else {
-            break;
+    }
+    if (ok) {
+        order_entries_into(list.entries, committed, ordered);
+        order_entries_into(list.entries + committed, list.count - committed, ordered + committed);
+        ok = write_incremental_output(temp_path, have_state ? &old_output : NULL, &state,
+                                      ordered, committed, list.count);
+    }
+    
+    if (have_output) {
+        unmap_file(&old_output);
+    }
+    if (ok) {
+        remove(output_path);
+        if (rename(temp_path, output_path) != 0) {
+            printf("Error writing file: %s\n", output_path);
+            ok = 0;
         }
+    } else {
+        remove(temp_path);
+    }
+    if (ok) {
+        save_state(state_path, &state, keys);
     }
     
-    return entries;
+    if (!list_freed) {
+        free_entry_list(&list);
+    }
+    free(ordered);
+    free(keys);
+    free(cleaned);
+    unmap_file(&input);
+    free(state_path);
+    free(temp_path);
+}
+
+// ---- Metrics ---------------------------------------------------------------
+//
+// With --metrics, the stage times of a single-file run and the parser's
+// counters are written as JSON next to the output (<output>.metrics.json).
+// Without it the clock is never read and only the counters, a few
+// increments per record, are kept.
+
+typedef struct {
+    int enabled;
+    const char *mode;       // "file", "parallel", "fused" or "stream"
+    int threads;
+    double read_clean;      // seconds; 0 in stream mode, where parse covers it
+    double parse;           // includes the dedup
+    double sort;
+    double write;
+    double total;
+} RunMetrics;
+
+// Current time in seconds, or 0 when metrics are off
+double metrics_clock(const RunMetrics *metrics) {
+    if (!metrics->enabled) return 0;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
 }
 
-// Write entries to output file
-void write_output(FILE *fp, Entry *entries, int count) {
-    for (int i = 0; i < count; i++) {
-        fprintf(fp, "First Name: %s\n", entries[i].first_name);
-        fprintf(fp, "Second Name: %s\n", entries[i].second_name);
-        fprintf(fp, "Fingerprint: %s\n", entries[i].fingerprint);
-        fprintf(fp, "Position: %s\n", entries[i].position);
-        fprintf(fp, "\n");
+// Number of corruption characters in text[0..n), which is what stripping
+// them would have removed
+size_t count_corruption(const char *text, size_t n) {
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++) {
+        count += corruption_table[(unsigned char)text[i]];
     }
+    return count;
+}
+
+// Write the metrics of a run to <output>.metrics.json
+void write_metrics(const char *output, const RunMetrics *metrics,
+                   const CleanCounters *counters, size_t records_written) {
+    char *path = (char *)malloc(strlen(output) + sizeof(".metrics.json"));
+    if (path == NULL) {
+        printf("Memory allocation failed\n");
+        return;
+    }
+    sprintf(path, "%s.metrics.json", output);
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL) {
+        printf("Error opening file: %s\n", path);
+        free(path);
+        return;
+    }
+    
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"mode\": \"%s\",\n", metrics->mode);
+    fprintf(fp, "  \"threads\": %d,\n", metrics->threads);
+    fprintf(fp, "  \"seconds\": {\n");
+    fprintf(fp, "    \"read_clean\": %.6f,\n", metrics->read_clean);
+    fprintf(fp, "    \"parse\": %.6f,\n", metrics->parse);
+    fprintf(fp, "    \"sort\": %.6f,\n", metrics->sort);
+    fprintf(fp, "    \"write\": %.6f,\n", metrics->write);
+    fprintf(fp, "    \"total\": %.6f\n", metrics->total);
+    fprintf(fp, "  },\n");
+    fprintf(fp, "  \"bytes_read\": %zu,\n", counters->bytes_read);
+    fprintf(fp, "  \"bytes_stripped\": %zu,\n", counters->bytes_stripped);
+    fprintf(fp, "  \"records_seen\": %zu,\n", counters->records_seen);
+    fprintf(fp, "  \"duplicates_dropped\": %zu,\n", counters->duplicates);
+    fprintf(fp, "  \"bad_fingerprints\": %zu,\n", counters->bad_fingerprints);
+    fprintf(fp, "  \"entries_reallocs\": %zu,\n", counters->entry_reallocs);
+    fprintf(fp, "  \"records_written\": %zu\n", records_written);
+    fprintf(fp, "}\n");
+    
+    if (fclose(fp) != 0) {
+        printf("Error writing file: %s\n", path);
+    }
+    free(path);
 }
 
 int main(int argc, char **argv) {
-    if (argc != 3) {
-        printf("Usage: %s <input_corrupted.txt> <output_clean.txt>\n", argv[0]);
+    cleaner_init();
+    const char *program = argv[0];
+    
+    // Optional flags before the two paths:
+    //   --stream     bounded-memory chunked reading ("-" as input reads stdin)
+    //   --threads N  parse on N threads (batch mode: N workers, default one
+    //                per CPU)
+    //   --batch      the paths are a manifest or directory of inputs and an
+    //                output directory
+    //   --metrics    write stage times and counters to <output>.metrics.json
+    //                (not with --batch or --incremental)
+    //   --incremental  parse only what was appended since the last run,
+    //                keeping state in <output>.state
+    //   --binary     write the compact format of clean_binary.h instead of text
+    //   --fused      parse the mapped input directly, stepping over corruption,
+    //                instead of stripping it into a cleaned copy first
+    // Or, to combine the outputs of shards of one dump cleaned separately:
+    //   --merge <output_clean.txt> <shard_clean.txt>...  (shards in dump order)
+    if (argc > 3 && strcmp(argv[1], "--merge") == 0) {
+        merge_clean_files(argv + 3, (size_t)(argc - 3), argv[2]);
         return 0;
     }
-    // TODO: implement
-    
-    FILE *corrupted_text = fopen(argv[1], "r");
-    if (corrupted_text == NULL) {
-        printf("Error opening file: %s\n", argv[1]);
+    int stream = 0;
+    int fused = 0;
+    int batch = 0;
+    int incremental = 0;
+    int binary = 0;
+    int threads = 0;
+    RunMetrics metrics = {0, "file", 1, 0, 0, 0, 0, 0};
+    while (argc > 3 && strncmp(argv[1], "--", 2) == 0) {
+        if (strcmp(argv[1], "--stream") == 0) {
+            stream = 1;
+        } else if (strcmp(argv[1], "--metrics") == 0) {
+            metrics.enabled = 1;
+        } else if (strcmp(argv[1], "--incremental") == 0) {
+            incremental = 1;
+        } else if (strcmp(argv[1], "--binary") == 0) {
+            binary = 1;
+        } else if (strcmp(argv[1], "--fused") == 0) {
+            fused = 1;
+        } else if (strcmp(argv[1], "--batch") == 0) {
+            batch = 1;
+        } else if (strcmp(argv[1], "--threads") == 0 && argc > 4) {
+            threads = atoi(argv[2]);
+            if (threads < 1) threads = -1;
+            argv++;
+            argc--;
+        } else {
+            break;
+        }
+        argv++;
+        argc--;
+    }
+    if (argc != 3 || threads < 0 || threads > MAX_PARSE_THREADS || (metrics.enabled && (batch || incremental))) {
+        printf("Usage: %s [--stream|--fused] [--threads N] [--metrics] [--binary] <input_corrupted.txt> <output_clean.txt>\n"
+               "       %s --incremental <input_corrupted.txt> <output_clean.txt>\n"
+               "       %s [--threads N] --batch <manifest|input_dir> <output_dir>\n"
+               "       %s --merge <output_clean.txt> <shard_clean.txt>...\n", program, program, program, program);
         return 0;
     }
     
-    char *cleaned_text = read_and_clean_file(corrupted_text);
-    fclose(corrupted_text);
-    
-    if (cleaned_text == NULL) {
+    if (batch) {
+        if (threads == 0) {
+            long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+            threads = cpus < 1 ? 1 : cpus > MAX_PARSE_THREADS ? MAX_PARSE_THREADS : (int)cpus;
+        }
+        run_batch(argv[1], argv[2], threads);
         return 0;
     }
+    if (incremental) {
+        run_incremental(argv[1], argv[2]);
+        return 0;
+    }
+    if (threads == 0) {
+        threads = 1;
+    }
     
-    int entry_count = 0;
-    Entry *entries = parse_entries(cleaned_text, &entry_count);
-    
-    free(cleaned_text);
+    // Entries are views into the cleaned text (or, fused, the mapped input),
+    // which therefore lives until the output is written (the streaming path
+    // copies what it keeps)
+    EntryList list;
+    char *cleaned_text = NULL;
+    MappedFile input;
+    int mapped = 0;
+    size_t input_size = 0, cleaned_len = 0;
+    int parsed = 0;
+    double started = metrics_clock(&metrics);
+    double mark = started;
+    
+    if (strcmp(argv[1], "-") == 0) {
+        metrics.mode = "stream";
+        parsed = stream_and_parse(stdin, &list);
+    } else if (stream) {
+        FILE *corrupted_text = fopen(argv[1], "rb");
+        if (corrupted_text == NULL) {
+            printf("Error opening file: %s\n", argv[1]);
+            return 0;
+        }
+        metrics.mode = "stream";
+        parsed = stream_and_parse(corrupted_text, &list);
+        fclose(corrupted_text);
+    } else if (fused) {
+        // No cleaned copy: the parser steps over corruption in place
+        if (!map_file(argv[1], &input)) {
+            printf("Error opening file: %s\n", argv[1]);
+            return 0;
+        }
+        mapped = 1;
+        metrics.mode = "fused";
+        metrics.threads = threads;
+        if (threads > 1) {
+            parsed = parse_entries_parallel(input.data, input.size, &list, threads);
+        } else {
+            parsed = parse_entries(input.data, input.size, &list);
+        }
+        if (parsed) {
+            list.counters.bytes_read = input.size;
+        }
+    } else {
+        cleaned_text = read_and_clean_file(argv[1], &input_size, &cleaned_len);
+        if (cleaned_text == NULL) {
+            return 0;
+        }
+        double now = metrics_clock(&metrics);
+        metrics.read_clean = now - mark;
+        mark = now;
+        if (threads > 1) {
+            metrics.mode = "parallel";
+            metrics.threads = threads;
+            parsed = parse_entries_parallel(cleaned_text, cleaned_len, &list, threads);
+        } else {
+            parsed = parse_entries(cleaned_text, cleaned_len, &list);
+        }
+        if (parsed) {
+            list.counters.bytes_read = input_size;
+            list.counters.bytes_stripped = input_size - cleaned_len;
+        }
+    }
     
-    if (entries == NULL) {
+    if (!parsed) {
+        if (mapped) unmap_file(&input);
+        free(cleaned_text);
         return 0;
     }
+    double now = metrics_clock(&metrics);
+    metrics.parse = now - mark;
+    mark = now;
+    
+    Entry *ordered = order_entries(list.entries, list.count);
+    if (ordered == NULL) {
+        free_entry_list(&list);
+        if (mapped) unmap_file(&input);
+        free(cleaned_text);
+        return 0;
+    }
+    list.entries = ordered;
+    now = metrics_clock(&metrics);
+    metrics.sort = now - mark;
+    mark = now;
     
-    qsort(entries, entry_count, sizeof(Entry), compare_entries);
-    
-    FILE *clean_text = fopen(argv[2], "w");
+    FILE *clean_text = fopen(argv[2], binary ? "wb" : "w");
     if (clean_text == NULL) {
         printf("Error opening file: %s\n", argv[2]);
-        free_entries(entries, entry_count);
+        free_entry_list(&list);
+        if (mapped) unmap_file(&input);
+        free(cleaned_text);
         return 0;
     }
     
-    write_output(clean_text, entries, entry_count);
+    int written = binary ? write_binary_records(clean_text, list.entries, list.count)
+                         : write_records(clean_text, list.entries, list.count);
+    if (!written) {
+        printf("Error writing file: %s\n", argv[2]);
+    }
     fclose(clean_text);
+    now = metrics_clock(&metrics);
+    metrics.write = now - mark;
+    metrics.total = now - started;
+    
+    if (metrics.enabled) {
+        // The fused parser steps over corruption without stripping it, so
+        // it is counted here, outside the timed stages
+        if (mapped) {
+            list.counters.bytes_stripped = count_corruption(input.data, input.size);
+        }
+        write_metrics(argv[2], &metrics, &list.counters, list.count);
+    }
     
-    free_entries(entries, entry_count);
+    free_entry_list(&list);
+    if (mapped) unmap_file(&input);
+    free(cleaned_text);
     
     return 0;
 }
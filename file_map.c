@@ -0,0 +1,138 @@
+#define _POSIX_C_SOURCE 200112L
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include "file_map.h"
+
+#ifndef _WIN32
+#define FILE_MAP_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define READ_CHUNK_SIZE (64 * 1024)
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define HUGE_BUFFER_MIN (64 * 1024 * 1024)
+
+// Read everything from fp into a malloc'd, NUL-terminated buffer
+static int read_all(FILE *fp, MappedFile *file) {
+    size_t capacity = READ_CHUNK_SIZE;
+    size_t size = 0;
+    char *data = (char *)malloc(capacity + 1);
+    if (data == NULL) {
+        printf("Memory allocation failed\n");
+        return 0;
+    }
+    
+    for (;;) {
+        if (size == capacity) {
+            capacity *= 2;
+            char *temp = (char *)realloc(data, capacity + 1);
+            if (temp == NULL) {
+                printf("Memory allocation failed\n");
+                free(data);
+                return 0;
+            }
+            data = temp;
+        }
+        size_t n = fread(data + size, 1, capacity - size, fp);
+        size += n;
+        if (n == 0) break;
+    }
+    if (ferror(fp)) {
+        printf("Error reading file\n");
+        free(data);
+        return 0;
+    }
+    
+    data[size] = '\0';
+    file->data = data;
+    file->size = size;
+    file->mapped_size = 0;
+    return 1;
+}
+
+int map_file(const char *path, MappedFile *file) {
+    file->data = NULL;
+    file->size = 0;
+    file->mapped_size = 0;
+    
+#ifdef FILE_MAP_MMAP
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        size_t size = (size_t)st.st_size;
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        
+        // The bytes after the end of the file up to the end of its last page
+        // read as zero, which gives the terminator for free. A file that
+        // fills its last page exactly has no room for it, so it is read.
+        if (size % page != 0) {
+            void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                posix_madvise(data, size, POSIX_MADV_SEQUENTIAL);
+                close(fd);
+                file->data = (const char *)data;
+                file->size = size;
+                file->mapped_size = size;
+                return 1;
+            }
+        }
+    }
+    
+    FILE *fp = fdopen(fd, "rb");
+    if (fp == NULL) {
+        close(fd);
+        return 0;
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+#else
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return 0;
+    }
+#endif
+    
+    int ok = read_all(fp, file);
+    fclose(fp);
+    return ok;
+}
+
+void unmap_file(MappedFile *file) {
+#ifdef FILE_MAP_MMAP
+    if (file->mapped_size > 0) {
+        munmap((void *)file->data, file->mapped_size);
+    } else {
+        free((void *)file->data);
+    }
+#else
+    free((void *)file->data);
+#endif
+    file->data = NULL;
+    file->size = 0;
+    file->mapped_size = 0;
+}
+
+void *alloc_huge_buffer(size_t size) {
+#if defined(FILE_MAP_MMAP) && defined(MADV_HUGEPAGE)
+    // Below this the TLB is not the bottleneck and whole huge pages only
+    // waste memory
+    if (size >= HUGE_BUFFER_MIN) {
+        void *data;
+        if (posix_memalign(&data, HUGE_PAGE_SIZE, size) == 0) {
+            // Only a hint: without transparent huge pages this is a no-op
+            madvise(data, size - size % HUGE_PAGE_SIZE, MADV_HUGEPAGE);
+            return data;
+        }
+    }
+#endif
+    return malloc(size);
+}
@@ -0,0 +1,31 @@
+#ifndef FILE_MAP_H
+#define FILE_MAP_H
+
+#include <stddef.h>
+
+/* Read-only contents of a whole file. data[size] reads as '\0' when
+   map_file returns, but a mapped file gets that byte from the zeroed rest
+   of its last page, and it is gone if the file grows while mapped. Scan
+   data[0..size) and never rely on the terminator. */
+typedef struct {
+    const char *data;
+    size_t size;
+    size_t mapped_size;     /* 0 when data is a malloc'd copy */
+} MappedFile;
+
+/* Makes the contents of path available in file. Regular files are
+   memory-mapped with a sequential-access hint, so pages already in the page
+   cache are used in place; other files (pipes, devices) and platforms
+   without mmap fall back to buffered reads. Returns 0 on failure. */
+int map_file(const char *path, MappedFile *file);
+
+/* Releases what map_file set up. */
+void unmap_file(MappedFile *file);
+
+/* Like malloc, but a buffer of many megabytes is aligned to and backed by
+   transparent huge pages where the platform offers them, which cuts TLB
+   misses when a multi-GB input is swept. Release it with free; realloc
+   keeps working but may lose the huge pages. */
+void *alloc_huge_buffer(size_t size);
+
+#endif // FILE_MAP_H
@@ -0,0 +1,72 @@
+#ifndef FINGERPRINT_H
+#define FINGERPRINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FINGERPRINT_LEN 9
+
+/* Packs a 9-character alphanumeric fingerprint into a 64-bit key, 6 bits per
+   character. Valid fingerprints never pack to 0, so 0 can mark empty slots.
+   Returns 0 if a character is not [0-9A-Za-z]. Always reads all 9 bytes;
+   the table lookup avoids a hard-to-predict branch per character. */
+static inline uint64_t pack_fingerprint(const char *fp) {
+    // Code of each byte: 1-10 for digits, 11-36 for upper case, 37-62 for
+    // lower case, 0 for anything else (the other 128 entries included)
+    static const unsigned char codes[256] = {
+         0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+         0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+         0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+         1,  2,  3,  4,  5,  6,  7,  8,  9, 10,  0,  0,  0,  0,  0,  0,
+         0, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25,
+        26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36,  0,  0,  0,  0,  0,
+         0, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51,
+        52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 62,  0,  0,  0,  0,  0,
+    };
+    uint64_t key = 0;
+    unsigned char invalid = 0;
+    for (int i = 0; i < FINGERPRINT_LEN; i++) {
+        unsigned char code = codes[(unsigned char)fp[i]];
+        invalid |= code == 0;
+        key = (key << 6) | code;
+    }
+    return invalid ? 0 : key;
+}
+
+/* Inverse of pack_fingerprint: writes the 9 characters and a terminator. */
+static inline void unpack_fingerprint(uint64_t key, char *out) {
+    static const char digits[] =
+        "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+    for (int i = FINGERPRINT_LEN - 1; i >= 0; i--) {
+        out[i] = digits[(key & 63) - 1];
+        key >>= 6;
+    }
+    out[FINGERPRINT_LEN] = '\0';
+}
+
+/* Returns 1 if key is something pack_fingerprint can return for a valid
+   fingerprint: nine 6-bit codes, each in 1-62, and nothing above them. Keys
+   read from a file must pass this before unpack_fingerprint sees them. */
+static inline int fingerprint_key_valid(uint64_t key) {
+    if (key >> (6 * FINGERPRINT_LEN) != 0) return 0;
+    for (int i = 0; i < FINGERPRINT_LEN; i++) {
+        uint64_t code = key & 63;
+        if (code == 0 || code > 62) return 0;
+        key >>= 6;
+    }
+    return 1;
+}
+
+/* Hash of a packed fingerprint for open-addressing tables. Packed keys are
+   highly structured (6 bits per character), so all the bits are mixed
+   before the low ones are used as a slot index. */
+static inline size_t hash_fingerprint(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return (size_t)key;
+}
+
+#endif // FINGERPRINT_H
@@ -0,0 +1,83 @@
+#include <stdlib.h>
+#include <string.h>
+#include "fp_set.h"
+#include "fingerprint.h"
+#include "open_table.h"
+
+#define FP_SET_MIN_CAPACITY 16
+
+int fp_set_init(FpSet *set, size_t expected) {
+    size_t capacity = open_table_capacity(expected, FP_SET_MIN_CAPACITY);
+    set->slots = (uint64_t *)calloc(capacity, sizeof(uint64_t));
+    if (set->slots == NULL) {
+        set->capacity = 0;
+        set->count = 0;
+        return 0;
+    }
+    set->capacity = capacity;
+    set->count = 0;
+    return 1;
+}
+
+static size_t hash_slot(const void *slot) {
+    return hash_fingerprint(*(const uint64_t *)slot);
+}
+
+// Double the table and reinsert every key
+static int grow(FpSet *set) {
+    size_t capacity = set->capacity ? set->capacity * 2 : FP_SET_MIN_CAPACITY;
+    uint64_t *slots = (uint64_t *)open_table_rehash(set->slots, set->capacity, capacity,
+                                                    sizeof(uint64_t), hash_slot);
+    if (slots == NULL) {
+        return 0;
+    }
+    free(set->slots);
+    set->slots = slots;
+    set->capacity = capacity;
+    return 1;
+}
+
+int fp_set_insert(FpSet *set, uint64_t key) {
+    if (open_table_full(set->count, set->capacity)) {
+        if (!grow(set)) {
+            return -1;
+        }
+    }
+    
+    size_t mask = set->capacity - 1;
+    size_t slot = hash_fingerprint(key) & mask;
+    while (set->slots[slot] != 0) {
+        if (set->slots[slot] == key) {
+            return 0;
+        }
+        slot = (slot + 1) & mask;
+    }
+    
+    set->slots[slot] = key;
+    set->count++;
+    return 1;
+}
+
+size_t fp_set_keys(const FpSet *set, uint64_t *out) {
+    size_t n = 0;
+    for (size_t i = 0; i < set->capacity; i++) {
+        if (set->slots[i] != 0) {
+            out[n++] = set->slots[i];
+        }
+    }
+    return n;
+}
+
+void fp_set_clear(FpSet *set) {
+    if (set->slots != NULL) {
+        memset(set->slots, 0, set->capacity * sizeof(uint64_t));
+    }
+    set->count = 0;
+}
+
+void fp_set_free(FpSet *set) {
+    free(set->slots);
+    set->slots = NULL;
+    set->capacity = 0;
+    set->count = 0;
+}
@@ -0,0 +1,33 @@
+#ifndef FP_SET_H
+#define FP_SET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Open-addressing hash set of packed fingerprints (see fingerprint.h).
+   Keys are stored directly; 0 marks an empty slot. */
+typedef struct {
+    uint64_t *slots;
+    size_t capacity;    /* power of two */
+    size_t count;
+} FpSet;
+
+/* Initializes an empty set sized for about expected keys. Returns 0 on
+   allocation failure. */
+int fp_set_init(FpSet *set, size_t expected);
+
+/* Adds key (non-zero). Returns 1 if it was added, 0 if it was already
+   present and -1 on allocation failure. */
+int fp_set_insert(FpSet *set, uint64_t key);
+
+/* Copies every key, in no particular order, to out (room for set->count
+   keys). Returns the number copied. */
+size_t fp_set_keys(const FpSet *set, uint64_t *out);
+
+/* Removes every key but keeps the table for reuse. */
+void fp_set_clear(FpSet *set);
+
+/* Releases the table. */
+void fp_set_free(FpSet *set);
+
+#endif // FP_SET_H
@@ -0,0 +1,90 @@
+// Writes a synthetic corrupted org dump for testing and benchmarking ex1.
+// Build: gcc -O2 -o gen_corpus gen_corpus.c corpus_gen.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "corpus_gen.h"
+
+#define OUTPUT_BUFFER_SIZE (1024 * 1024)
+
+// Read a percentage option into *percent, returns 0 unless value is a
+// whole number from 0 to 100
+static int parse_percent(const char *value, int *percent) {
+    char *end;
+    long n = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || n < 0 || n > 100) {
+        return 0;
+    }
+    *percent = (int)n;
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    const char *program = argv[0];
+    CorpusParams params;
+    corpus_default_params(&params, 1);
+    
+    // Options come in pairs before the output path
+    while (argc > 3 && strncmp(argv[1], "--", 2) == 0) {
+        const char *option = argv[1];
+        const char *value = argv[2];
+        int valid = 1;
+        if (strcmp(option, "--records") == 0) {
+            params.records = strtoull(value, NULL, 10);
+        } else if (strcmp(option, "--seed") == 0) {
+            params.seed = strtoull(value, NULL, 10);
+        } else if (strcmp(option, "--corruption") == 0) {
+            valid = parse_percent(value, &params.corruption_percent);
+        } else if (strcmp(option, "--label-space") == 0) {
+            valid = parse_percent(value, &params.label_space_percent);
+        } else if (strcmp(option, "--duplicates") == 0) {
+            valid = parse_percent(value, &params.duplicate_percent);
+        } else if (strcmp(option, "--bad-fingerprints") == 0) {
+            valid = parse_percent(value, &params.bad_fingerprint_percent);
+        } else {
+            break;
+        }
+        if (!valid) {
+            printf("Invalid percentage for %s: %s (expected 0 to 100)\n", option, value);
+            return 1;
+        }
+        argv += 2;
+        argc -= 2;
+    }
+    if (argc != 2) {
+        printf("Usage: %s [--records N] [--seed S] [--corruption P] [--label-space P]\n"
+               "       [--duplicates P] [--bad-fingerprints P] <output.txt>\n", program);
+        return 1;
+    }
+    
+    FILE *fp = fopen(argv[1], "wb");
+    if (fp == NULL) {
+        printf("Error opening file: %s\n", argv[1]);
+        return 1;
+    }
+    char *buffer = (char *)malloc(OUTPUT_BUFFER_SIZE);
+    CorpusGen *gen = (CorpusGen *)malloc(sizeof(CorpusGen));
+    if (buffer == NULL || gen == NULL) {
+        printf("Memory allocation failed\n");
+        free(buffer);
+        free(gen);
+        fclose(fp);
+        return 1;
+    }
+    
+    corpus_init(gen, &params);
+    int failed = 0;
+    size_t n;
+    while ((n = corpus_next(gen, buffer, OUTPUT_BUFFER_SIZE)) > 0) {
+        if (fwrite(buffer, 1, n, fp) != n) {
+            printf("Error writing file: %s\n", argv[1]);
+            failed = 1;
+            break;
+        }
+    }
+    if (fclose(fp) != 0) failed = 1;
+    
+    free(buffer);
+    free(gen);
+    return failed;
+}
@@ -0,0 +1,164 @@
+#include <stdlib.h>
+#include <string.h>
+#include "label_scan.h"
+#include "strip.h"
+
+// The labels start with 'F', 'S' or 'P' and none of those letters occurs
+// anywhere else in a label, so a failed partial match can never hide the
+// start of another one. On a mismatch the automaton just restarts from the
+// root with the current character, which keeps the scan strictly linear.
+
+#define MAX_STATES 48
+
+// Layout of a step table entry: the next state, plus what taking the step
+// means for the label being matched
+#define STEP_STATE  0x3F    // next state
+#define STEP_START  0x40    // the byte is the first character of a label
+#define STEP_ACCEPT 0x80    // the byte completes a label...
+#define STEP_KIND_SHIFT 8   // ...whose LabelKind is stored here
+
+static const char *const label_text[] = {
+    "FirstName:", "SecondName:", "Fingerprint:", "Position:"
+};
+
+// step[state][byte] folds the whole per-byte decision into one lookup: bytes
+// that never break a label (whitespace, and corruption so that raw,
+// unstripped text scans the same as its cleaned copy) keep the state, a
+// mismatch restarts from the root with the same byte, and a completed label
+// goes back to the root. The scan loop is then a load and a rarely taken
+// branch per byte.
+static unsigned short step[MAX_STATES][256];
+static int automaton_ready = 0;
+
+void label_scan_init(void) {
+    if (automaton_ready) return;
+    
+    // Trie over the four labels: transitions[state][byte] is the next state,
+    // -1 when the byte breaks the match. accept[state] is the label completed
+    // in that state, or -1.
+    static short transitions[MAX_STATES][256];
+    static signed char accept[MAX_STATES];
+    int state_count = 1;
+    memset(transitions, 0xFF, sizeof(transitions));
+    memset(accept, -1, sizeof(accept));
+    
+    for (int k = 0; k < 4; k++) {
+        int state = 0;
+        for (const char *p = label_text[k]; *p != '\0'; p++) {
+            unsigned char c = (unsigned char)*p;
+            if (transitions[state][c] < 0) {
+                transitions[state][c] = (short)state_count++;
+            }
+            state = transitions[state][c];
+        }
+        accept[state] = (signed char)k;
+    }
+    
+    for (int state = 0; state < state_count; state++) {
+        for (int c = 0; c < 256; c++) {
+            if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || corruption_table[c]) {
+                step[state][c] = (unsigned short)state;
+                continue;
+            }
+            int next = transitions[state][c];
+            if (next < 0) {
+                next = transitions[0][c];
+            }
+            if (next < 0) {
+                step[state][c] = 0;
+            } else if (accept[next] >= 0) {
+                step[state][c] = (unsigned short)(STEP_ACCEPT | (accept[next] << STEP_KIND_SHIFT));
+            } else if (transitions[0][c] == next) {
+                step[state][c] = (unsigned short)(STEP_START | next);
+            } else {
+                step[state][c] = (unsigned short)next;
+            }
+        }
+    }
+    
+    automaton_ready = 1;
+}
+
+static int push_hit(LabelScan *scan, size_t start, size_t end, int kind) {
+    if (scan->count >= scan->capacity) {
+        size_t capacity = scan->capacity ? scan->capacity * 2 : 64;
+        LabelHit *temp = (LabelHit *)realloc(scan->hits, capacity * sizeof(LabelHit));
+        if (temp == NULL) {
+            return 0;
+        }
+        scan->hits = temp;
+        scan->capacity = capacity;
+    }
+    scan->hits[scan->count].start = start;
+    scan->hits[scan->count].end = end;
+    scan->hits[scan->count].kind = (LabelKind)kind;
+    scan->count++;
+    return 1;
+}
+
+int scan_labels(LabelScan *scan, const char *text, size_t len) {
+    return scan_labels_range(scan, text, len, 0, len);
+}
+
+int scan_labels_range(LabelScan *scan, const char *text, size_t len, size_t from, size_t to) {
+    label_scan_init();
+    scan->count = 0;
+    
+    int state = 0;
+    size_t start = 0;
+    size_t i = from;
+    
+    for (; i < to; i++) {
+        // Between labels, nothing matters until a byte that can start one;
+        // this test does not wait on the previous lookup the way a step does
+        if (state == 0) {
+            while (i < to && !(step[0][(unsigned char)text[i]] & STEP_START)) {
+                i++;
+            }
+            if (i == to) {
+                break;
+            }
+        }
+        unsigned e = step[state][(unsigned char)text[i]];
+        state = e & STEP_STATE;
+        if (e & (STEP_START | STEP_ACCEPT)) {
+            if (e & STEP_START) {
+                start = i;
+            } else if (!push_hit(scan, start, i + 1, (int)(e >> STEP_KIND_SHIFT))) {
+                return 0;
+            }
+        }
+    }
+    
+    // Past the range, only a label already in progress is finished
+    for (; i < len && state != 0; i++) {
+        unsigned e = step[state][(unsigned char)text[i]];
+        if (e & STEP_START) {
+            break;
+        }
+        state = e & STEP_STATE;
+        if ((e & STEP_ACCEPT) && !push_hit(scan, start, i + 1, (int)(e >> STEP_KIND_SHIFT))) {
+            return 0;
+        }
+    }
+    
+    return 1;
+}
+
+const LabelHit *next_label(const LabelScan *scan, size_t *cursor, LabelKind kind, size_t from) {
+    for (size_t i = *cursor; i < scan->count; i++) {
+        if (scan->hits[i].kind == kind && scan->hits[i].start >= from) {
+            *cursor = i + 1;
+            return &scan->hits[i];
+        }
+    }
+    *cursor = scan->count;
+    return NULL;
+}
+
+void free_label_scan(LabelScan *scan) {
+    free(scan->hits);
+    scan->hits = NULL;
+    scan->count = 0;
+    scan->capacity = 0;
+}
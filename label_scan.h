@@ -0,0 +1,54 @@
+#ifndef LABEL_SCAN_H
+#define LABEL_SCAN_H
+
+#include <stddef.h>
+
+/* The four record labels, as they appear with all whitespace removed. */
+typedef enum {
+    LABEL_FIRST_NAME = 0,   /* "FirstName:"   */
+    LABEL_SECOND_NAME = 1,  /* "SecondName:"  */
+    LABEL_FINGERPRINT = 2,  /* "Fingerprint:" */
+    LABEL_POSITION = 3      /* "Position:"    */
+} LabelKind;
+
+/* One label occurrence: start is the offset of its first character, end the
+   offset just past its ':'. Whitespace and corruption characters inside the
+   label are allowed, so unstripped text gives the same labels as its
+   cleaned copy (at the corresponding offsets). */
+typedef struct {
+    size_t start;
+    size_t end;
+    LabelKind kind;
+} LabelHit;
+
+/* Growable list of label occurrences, in text order. */
+typedef struct {
+    LabelHit *hits;
+    size_t count;
+    size_t capacity;
+} LabelScan;
+
+/* Builds the matching automaton. Called automatically on first use; call it
+   once at startup before starting any threads. */
+void label_scan_init(void);
+
+/* Finds every label in text[0..len) in one left-to-right pass, replacing the
+   previous contents of scan. Returns 0 on allocation failure. */
+int scan_labels(LabelScan *scan, const char *text, size_t len);
+
+/* Like scan_labels, but only reports the labels that start in [from, to).
+   A label that starts before to is followed past it, so scanning adjacent
+   ranges and concatenating the results gives the same hits as one scan of
+   the whole text. The ranges can therefore be scanned in parallel. */
+int scan_labels_range(LabelScan *scan, const char *text, size_t len, size_t from, size_t to);
+
+/* The first hit of the given kind at or after *cursor whose start is at or
+   after from, or NULL if there is none. Hits before the returned one are
+   skipped for good: *cursor is moved past it. Searches must therefore be made
+   with non-decreasing from offsets. */
+const LabelHit *next_label(const LabelScan *scan, size_t *cursor, LabelKind kind, size_t from);
+
+/* Releases the hit array. */
+void free_label_scan(LabelScan *scan);
+
+#endif // LABEL_SCAN_H
@@ -0,0 +1,64 @@
+#ifndef OPEN_TABLE_H
+#define OPEN_TABLE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Sizing and growth shared by the open-addressing tables (FpSet, StringPool
+   and the node index of an Org). Capacities are powers of two, probing is
+   linear, and at most half the slots are used, which keeps probe runs
+   short. A slot whose bytes are all zero is empty. */
+
+/* Smallest power of two, at least min_capacity, that holds count keys. */
+static inline size_t open_table_capacity(size_t count, size_t min_capacity) {
+    size_t capacity = min_capacity;
+    while (capacity < count * 2) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+/* Returns 1 if the table must grow before it takes one more key. */
+static inline int open_table_full(size_t count, size_t capacity) {
+    return (count + 1) * 2 > capacity;
+}
+
+/* Returns 1 if the slot of slot_size bytes is empty. */
+static inline int open_table_slot_empty(const char *slot, size_t slot_size) {
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= slot_size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, slot + i, sizeof(word));
+        if (word != 0) return 0;
+    }
+    for (; i < slot_size; i++) {
+        if (slot[i] != 0) return 0;
+    }
+    return 1;
+}
+
+/* Returns a new table of new_capacity slots holding every key of the
+   capacity slots of slot_size bytes at slots, each placed where hash says,
+   or NULL on allocation failure. The old table is left to the caller. */
+static inline void *open_table_rehash(const void *slots, size_t capacity, size_t new_capacity,
+                                      size_t slot_size, size_t (*hash)(const void *slot)) {
+    char *table = (char *)calloc(new_capacity, slot_size);
+    if (table == NULL) {
+        return NULL;
+    }
+    
+    size_t mask = new_capacity - 1;
+    for (size_t i = 0; i < capacity; i++) {
+        const char *entry = (const char *)slots + i * slot_size;
+        if (open_table_slot_empty(entry, slot_size)) continue;
+        size_t slot = hash(entry) & mask;
+        while (!open_table_slot_empty(table + slot * slot_size, slot_size)) {
+            slot = (slot + 1) & mask;
+        }
+        memcpy(table + slot * slot_size, entry, slot_size);
+    }
+    return table;
+}
+
+#endif // OPEN_TABLE_H
@@ -3,178 +3,436 @@
 #include <string.h>
 #include <ctype.h>
 #include "org_tree.h"
+#include "file_map.h"
+#include "entry.h"
+#include "fingerprint.h"
+#include "open_table.h"
+#include "clean_binary.h"
+#include "strip.h"
 
-// Helper function to parse a single node from text starting at ptr
-static Node* parse_node(char **ptr) {
-    Node *node = (Node*)malloc(sizeof(Node));
-    if (node == NULL) {
-        return NULL;
+// Longest position value looked at, including the terminator
+#define MAX_POSITION 32
+
+// First capacity of a hand's support array
+#define MIN_SUPPORT_CAPACITY 16
+
+// Smallest fingerprint index
+#define MIN_INDEX_CAPACITY 16
+
+// Nodes in the first slab; each later slab doubles, up to the maximum
+#define MIN_SLAB_NODES 64
+#define MAX_SLAB_NODES (64 * 1024)
+
+// A block of nodes handed out in order
+struct NodeSlab {
+    NodeSlab *prev;
+    size_t used;
+    size_t capacity;
+    Node nodes[];
+};
+
+// Helper function to take the next node from the slabs, starting a new slab
+// when the newest one is full. Returns NULL on allocation failure.
+static Node *alloc_node(Org *tree) {
+    NodeSlab *slab = tree->slabs;
+    if (slab == NULL || slab->used == slab->capacity) {
+        size_t capacity = slab == NULL ? MIN_SLAB_NODES : slab->capacity * 2;
+        if (capacity > MAX_SLAB_NODES) capacity = MAX_SLAB_NODES;
+        slab = (NodeSlab*)malloc(sizeof(NodeSlab) + capacity * sizeof(Node));
+        if (slab == NULL) {
+            return NULL;
+        }
+        slab->prev = tree->slabs;
+        slab->used = 0;
+        slab->capacity = capacity;
+        tree->slabs = slab;
     }
+    return &slab->nodes[slab->used++];
+}
+
+// Helper function to append a support to a hand, doubling its array when
+// full. Returns 0 on allocation failure.
+static int append_support(Node *hand, Node *support) {
+    if (hand->support_count == hand->support_capacity) {
+        size_t capacity = hand->support_capacity ? hand->support_capacity * 2 : MIN_SUPPORT_CAPACITY;
+        Node **temp = (Node**)realloc(hand->supports, capacity * sizeof(Node*));
+        if (temp == NULL) {
+            return 0;
+        }
+        hand->supports = temp;
+        hand->support_capacity = capacity;
+    }
+    hand->supports[hand->support_count++] = support;
+    return 1;
+}
+
+// Helper function to print a single node
+static void print_node(const Node *node) {
+    if (node == NULL) return;
     
-    // Initialize node
+    char fingerprint[FINGERPRINT_LEN + 1];
+    node_fingerprint(node, fingerprint);
+    printf("First Name: %s\n", node->first);
+    printf("Second Name: %s\n", node->second);
+    printf("Fingerprint: %s\n", fingerprint);
+    printf("Position: %s\n", position_name((PositionType)node->position));
+    printf("\n");
+}
+
+// Helper function to link a node into the tree by its position; a support
+// needs its hand to be there already. A hand that is replaced keeps its
+// supports out of the tree. Returns 0 on allocation failure.
+static int attach_node(Org *tree, Node *node, PositionType type) {
+    if (type == BOSS) {
+        tree->boss = node;
+    } else if (type == RIGHT_HAND) {
+        if (tree->right_hand != NULL) {
+            free(tree->right_hand->supports);
+            tree->right_hand->supports = NULL;
+            tree->right_hand->support_count = 0;
+            tree->right_hand->support_capacity = 0;
+        }
+        tree->right_hand = node;
+        if (tree->boss != NULL) {
+            tree->boss->right = node;
+        }
+    } else if (type == LEFT_HAND) {
+        if (tree->left_hand != NULL) {
+            free(tree->left_hand->supports);
+            tree->left_hand->supports = NULL;
+            tree->left_hand->support_count = 0;
+            tree->left_hand->support_capacity = 0;
+        }
+        tree->left_hand = node;
+        if (tree->boss != NULL) {
+            tree->boss->left = node;
+        }
+    } else if (type == SUPPORT_RIGHT) {
+        return append_support(tree->right_hand, node);
+    } else if (type == SUPPORT_LEFT) {
+        return append_support(tree->left_hand, node);
+    }
+    return 1;
+}
+
+// Helper function to get the position type of a position value. The five
+// names all differ in length, so the length picks the only candidate.
+static PositionType position_type_of(const char *position, size_t len) {
+    switch (len) {
+        case 4:
+            if (memcmp(position, "Boss", 4) == 0) return BOSS;
+            break;
+        case 10:
+            if (memcmp(position, "Right Hand", 10) == 0) return RIGHT_HAND;
+            break;
+        case 9:
+            if (memcmp(position, "Left Hand", 9) == 0) return LEFT_HAND;
+            break;
+        case 13:
+            if (memcmp(position, "Support_Right", 13) == 0) return SUPPORT_RIGHT;
+            break;
+        case 12:
+            if (memcmp(position, "Support_Left", 12) == 0) return SUPPORT_LEFT;
+            break;
+    }
+    return UNKNOWN;
+}
+
+static void init_org(Org *tree) {
+    tree->boss = NULL;
+    tree->left_hand = NULL;
+    tree->right_hand = NULL;
+    tree->slabs = NULL;
+    string_pool_init(&tree->names);
+    tree->index.slots = NULL;
+    tree->index.capacity = 0;
+}
+
+// Helper function to make a node for one record and link it into the tree.
+// Records without a packed fingerprint or a known position, and supports
+// that come before their hand, are left out. Returns 0 on allocation
+// failure (already reported).
+static int add_node(Org *tree, const char *first, size_t first_len, const char *second, size_t second_len,
+                    uint64_t fingerprint, PositionType type) {
+    if (fingerprint == 0 || type == UNKNOWN ||
+        (type == SUPPORT_RIGHT && tree->right_hand == NULL) ||
+        (type == SUPPORT_LEFT && tree->left_hand == NULL)) {
+        return 1;
+    }
+    
+    Node *node = alloc_node(tree);
+    if (node == NULL) {
+        printf("Memory allocation failed\n");
+        return 0;
+    }
+    node->first = string_pool_intern(&tree->names, first, first_len);
+    node->second = string_pool_intern(&tree->names, second, second_len);
+    if (node->first == NULL || node->second == NULL) {
+        printf("Memory allocation failed\n");
+        return 0;
+    }
     node->left = NULL;
     node->right = NULL;
-    node->supports_head = NULL;
-    node->next = NULL;
+    node->supports = NULL;
+    node->support_count = 0;
+    node->support_capacity = 0;
+    node->fingerprint = fingerprint;
+    node->position = (uint8_t)type;
     
-    // Find and extract First Name
-    char *field = strstr(*ptr, "First Name: ");
-    if (field == NULL) {
-        free(node);
-        return NULL;
+    if (!attach_node(tree, node, type)) {
+        printf("Memory allocation failed\n");
+        return 0;
     }
-    field += strlen("First Name: ");
-    int i = 0;
-    while (*field != '\n' && *field != '\0' && i < MAX_FIELD - 1) {
-        node->first[i++] = *field++;
+    return 1;
+}
+
+// The labels of a text record, in the order they are read
+typedef enum {
+    LABEL_FIRST_NAME,
+    LABEL_SECOND_NAME,
+    LABEL_FINGERPRINT,
+    LABEL_POSITION,
+    LABEL_NONE
+} RecordLabel;
+
+// Helper function to tell which label a line starts with, going by its
+// first byte and then comparing only that label. Sets *label_len.
+static RecordLabel line_label(const char *line, size_t len, size_t *label_len) {
+    switch (line[0]) {
+        case 'F':
+            if (len >= 12 && memcmp(line, "First Name: ", 12) == 0) {
+                *label_len = 12;
+                return LABEL_FIRST_NAME;
+            }
+            if (len >= 13 && memcmp(line, "Fingerprint: ", 13) == 0) {
+                *label_len = 13;
+                return LABEL_FINGERPRINT;
+            }
+            break;
+        case 'S':
+            if (len >= 13 && memcmp(line, "Second Name: ", 13) == 0) {
+                *label_len = 13;
+                return LABEL_SECOND_NAME;
+            }
+            break;
+        case 'P':
+            if (len >= 10 && memcmp(line, "Position: ", 10) == 0) {
+                *label_len = 10;
+                return LABEL_POSITION;
+            }
+            break;
     }
-    node->first[i] = '\0';
+    return LABEL_NONE;
+}
+
+// Parse the text of a clean file in one pass over its lines. A record is
+// the next First Name, Second Name, Fingerprint and Position lines in that
+// order; any other line is skipped, and so is a record cut short by the
+// end of the text. A value runs to the end of its line (or a '\r') and is
+// handed to add_node in place, cut like the old copies were. Nothing at or
+// past text[size] is read.
+static void parse_clean_text(Org *tree, const char *text, size_t size) {
+    const char *end = text + size;
+    const char *values[LABEL_NONE];
+    size_t lens[LABEL_NONE];
+    RecordLabel expected = LABEL_FIRST_NAME;
     
-    // Find and extract Second Name
-    field = strstr(field, "Second Name: ");
-    if (field == NULL) {
-        free(node);
-        return NULL;
+    const char *line = text;
+    while (line < end) {
+        // Blank lines separate the records
+        if (*line == '\n') {
+            line++;
+            continue;
+        }
+        
+        size_t label_len = 0;
+        if (line_label(line, (size_t)(end - line), &label_len) != expected) {
+            const char *eol = (const char *)memchr(line, '\n', (size_t)(end - line));
+            line = eol != NULL ? eol + 1 : end;
+            continue;
+        }
+        
+        // Values are short, so one byte loop finds their end
+        const char *value = line + label_len;
+        const char *ptr = value;
+        while (ptr < end && *ptr != '\n' && *ptr != '\r') {
+            ptr++;
+        }
+        size_t len = (size_t)(ptr - value);
+        size_t limit = expected == LABEL_POSITION ? MAX_POSITION - 1 : MAX_FIELD - 1;
+        values[expected] = value;
+        lens[expected] = len < limit ? len : limit;
+        
+        if (ptr < end && *ptr != '\n') {
+            ptr = (const char *)memchr(ptr, '\n', (size_t)(end - ptr));
+            if (ptr == NULL) ptr = end;
+        }
+        line = ptr < end ? ptr + 1 : end;
+        
+        if (expected == LABEL_POSITION) {
+            uint64_t fingerprint = lens[LABEL_FINGERPRINT] == FINGERPRINT_LEN ? pack_fingerprint(values[LABEL_FINGERPRINT]) : 0;
+            if (!add_node(tree, values[LABEL_FIRST_NAME], lens[LABEL_FIRST_NAME],
+                          values[LABEL_SECOND_NAME], lens[LABEL_SECOND_NAME], fingerprint,
+                          position_type_of(values[LABEL_POSITION], lens[LABEL_POSITION]))) {
+                return;
+            }
+            expected = LABEL_FIRST_NAME;
+        } else {
+            expected++;
+        }
     }
-    field += strlen("Second Name: ");
-    i = 0;
-    while (*field != '\n' && *field != '\0' && i < MAX_FIELD - 1) {
-        node->second[i++] = *field++;
+}
+
+// Helper function to copy a string table entry into a buffer
+static size_t copy_field(char *dst, size_t size, const char *strings, size_t strings_size, uint32_t offset) {
+    size_t i = 0;
+    while (offset + i < strings_size && strings[offset + i] != '\0' && i < size - 1) {
+        dst[i] = strings[offset + i];
+        i++;
     }
-    node->second[i] = '\0';
-    
-    // Find and extract Fingerprint
-    field = strstr(field, "Fingerprint: ");
-    if (field == NULL) {
-        free(node);
-        return NULL;
+    dst[i] = '\0';
+    return i;
+}
+
+// Build the tree from a file in the binary format of clean_binary.h.
+// Nothing is scanned: every field is a fixed offset or a packed code.
+static void build_org_from_binary(Org *tree, const MappedFile *file) {
+    CleanBinaryHeader header;
+    if (file->size < sizeof(header)) {
+        return;
     }
-    field += strlen("Fingerprint: ");
-    i = 0;
-    while (*field != '\n' && *field != '\0' && i < MAX_FIELD - 1) {
-        node->fingerprint[i++] = *field++;
+    memcpy(&header, file->data, sizeof(header));
+    size_t records_size = (size_t)header.record_count * sizeof(CleanBinaryRecord);
+    if (header.version != CLEAN_BINARY_VERSION || header.record_size != sizeof(CleanBinaryRecord) ||
+        header.record_count > (file->size - sizeof(header)) / sizeof(CleanBinaryRecord) ||
+        header.strings_size > file->size - sizeof(header) - records_size) {
+        printf("Invalid binary clean file\n");
+        return;
     }
-    node->fingerprint[i] = '\0';
+    const char *records = file->data + sizeof(header);
+    const char *strings = records + records_size;
+    size_t strings_size = (size_t)header.strings_size;
     
-    // Find and extract Position
-    field = strstr(field, "Position: ");
-    if (field == NULL) {
-        free(node);
-        return NULL;
+    char first[MAX_FIELD];
+    char second[MAX_FIELD];
+    for (size_t i = 0; i < header.record_count; i++) {
+        CleanBinaryRecord record;
+        memcpy(&record, records + i * sizeof(record), sizeof(record));
+        if (record.pos_type >= UNKNOWN || !fingerprint_key_valid(record.fingerprint)) continue;
+        
+        size_t first_len = copy_field(first, MAX_FIELD, strings, strings_size, record.first_name);
+        size_t second_len = copy_field(second, MAX_FIELD, strings, strings_size, record.second_name);
+        if (!add_node(tree, first, first_len, second, second_len, record.fingerprint, (PositionType)record.pos_type)) {
+            break;
+        }
     }
-    field += strlen("Position: ");
-    i = 0;
-    while (*field != '\n' && *field != '\0' && i < MAX_POS - 1) {
-        node->position[i++] = *field++;
+}
+
+// Helper function to copy a record value into a buffer, dropping what ex1
+// drops when it writes the value
+static size_t copy_value(char *dst, size_t size, const char *value, size_t len) {
+    size_t n = 0;
+    for (size_t i = 0; i < len && n < size - 1; i++) {
+        if (value[i] == '\n' || value[i] == '\r' || corruption_table[(unsigned char)value[i]]) continue;
+        dst[n++] = value[i];
     }
-    node->position[i] = '\0';
-    
-    // Update pointer to continue parsing
-    *ptr = field;
-    
-    return node;
+    dst[n] = '\0';
+    return n;
 }
 
-// Helper function to append a node to the end of a linked list
-static void append_to_list(Node **head, Node *new_node) {
-    if (*head == NULL) {
-        *head = new_node;
-    } else {
-        Node *current = *head;
-        while (current->next != NULL) {
-            current = current->next;
-        }
-        current->next = new_node;
+// Helper function to add a node to the index, unless a node with its
+// fingerprint is already there
+static void index_node(NodeIndex *index, Node *node) {
+    size_t mask = index->capacity - 1;
+    size_t slot = hash_fingerprint(node->fingerprint) & mask;
+    while (index->slots[slot].fingerprint != 0) {
+        if (index->slots[slot].fingerprint == node->fingerprint) return;
+        slot = (slot + 1) & mask;
     }
+    index->slots[slot].fingerprint = node->fingerprint;
+    index->slots[slot].node = node;
 }
 
-// Helper function to print a single node
-static void print_node(const Node *node) {
-    if (node == NULL) return;
+// Helper function to index a hand and then its supports
+static void index_hand(NodeIndex *index, Node *hand) {
+    if (hand == NULL) return;
     
-    printf("First Name: %s\n", node->first);
-    printf("Second Name: %s\n", node->second);
-    printf("Fingerprint: %s\n", node->fingerprint);
-    printf("Position: %s\n", node->position);
-    printf("\n");
+    index_node(index, hand);
+    for (size_t i = 0; i < hand->support_count; i++) {
+        index_node(index, hand->supports[i]);
+    }
 }
 
-// Helper function to free a linked list of nodes
-static void free_list(Node *head) {
-    Node *current = head;
-    while (current != NULL) {
-        Node *next = current->next;
-        free(current);
-        current = next;
+// Index the finished tree in print order, so that the first node with a
+// fingerprint is the one kept. The index is sized once, for every node.
+// Without memory for it the tree stays unindexed and lookups walk it
+// instead.
+static void build_index(Org *tree) {
+    size_t count = 3;
+    if (tree->left_hand != NULL) count += tree->left_hand->support_count;
+    if (tree->right_hand != NULL) count += tree->right_hand->support_count;
+    size_t capacity = open_table_capacity(count, MIN_INDEX_CAPACITY);
+    
+    tree->index.slots = (NodeIndexSlot*)calloc(capacity, sizeof(NodeIndexSlot));
+    if (tree->index.slots == NULL) {
+        return;
+    }
+    tree->index.capacity = capacity;
+    
+    if (tree->boss != NULL) {
+        index_node(&tree->index, tree->boss);
     }
+    index_hand(&tree->index, tree->left_hand);
+    index_hand(&tree->index, tree->right_hand);
 }
 
 Org build_org_from_clean_file(const char *path) {
     Org tree;
-    tree.boss = NULL;
-    tree.left_hand = NULL;
-    tree.right_hand = NULL;
+    init_org(&tree);
     
-    // Open file
-    FILE* clean_file = fopen(path, "r");
-    if (clean_file == NULL) {
+    // Map the file (read-only)
+    MappedFile clean_file;
+    if (!map_file(path, &clean_file)) {
         return tree;
     }
     
-    // Get file size
-    fseek(clean_file, 0, SEEK_END);
-    long file_size = ftell(clean_file);
-    fseek(clean_file, 0, SEEK_SET);
-    
-    // Allocate and read file
-    char *org_text = (char *)malloc(file_size + 1);
-    if (org_text == NULL) {
-        printf("Memory allocation failed\n");
-        fclose(clean_file);
+    // ex1 --binary output needs no text parsing
+    if (clean_file.size >= sizeof(CleanBinaryHeader) &&
+        memcmp(clean_file.data, CLEAN_BINARY_MAGIC, 8) == 0) {
+        build_org_from_binary(&tree, &clean_file);
+        unmap_file(&clean_file);
+        build_index(&tree);
         return tree;
     }
     
-    fread(org_text, 1, file_size, clean_file);
-    org_text[file_size] = '\0';
-    fclose(clean_file);
+    // Parse all nodes from the file, which ends at its first NUL byte
+    const char *nul = (const char *)memchr(clean_file.data, '\0', clean_file.size);
+    parse_clean_text(&tree, clean_file.data, nul != NULL ? (size_t)(nul - clean_file.data) : clean_file.size);
     
-    // Parse all nodes from the file
-    char *ptr = org_text;
-    while (*ptr != '\0') {
-        // Skip to next "First Name: " occurrence
-        char *next_entry = strstr(ptr, "First Name: ");
-        if (next_entry == NULL) break;
-        
-        ptr = next_entry;
-        Node *node = parse_node(&ptr);
-        
-        if (node == NULL) continue;
+    unmap_file(&clean_file);
+    build_index(&tree);
+    return tree;
+}
+
+Org build_org_from_entries(const Entry *entries, size_t count) {
+    Org tree;
+    init_org(&tree);
+    
+    char first[MAX_FIELD];
+    char second[MAX_FIELD];
+    for (size_t i = 0; i < count; i++) {
+        const Entry *entry = &entries[i];
+        // A node with an unknown position has nowhere to go in the tree
+        if (entry->pos_type >= UNKNOWN) continue;
         
-        // Assign node to appropriate position in tree
-        if (strcmp(node->position, "Boss") == 0) {
-            tree.boss = node;
-        } else if (strcmp(node->position, "Right Hand") == 0) {
-            tree.right_hand = node;
-            if (tree.boss != NULL) {
-                tree.boss->right = node;
-            }
-        } else if (strcmp(node->position, "Left Hand") == 0) {
-            tree.left_hand = node;
-            if (tree.boss != NULL) {
-                tree.boss->left = node;
-            }
-        } else if (strcmp(node->position, "Support_Right") == 0) {
-            if (tree.right_hand != NULL) {
-                append_to_list(&(tree.right_hand->supports_head), node);
-            }
-        } else if (strcmp(node->position, "Support_Left") == 0) {
-            if (tree.left_hand != NULL) {
-                append_to_list(&(tree.left_hand->supports_head), node);
-            }
+        size_t first_len = copy_value(first, MAX_FIELD, entry->text, entry->first_len);
+        size_t second_len = copy_value(second, MAX_FIELD, entry->text + entry->second_offset, entry->second_len);
+        if (!add_node(&tree, first, first_len, second, second_len, entry->fingerprint, (PositionType)entry->pos_type)) {
+            break;
         }
     }
     
-    free(org_text);
+    build_index(&tree);
     return tree;
 }
 
@@ -191,10 +449,8 @@ void print_tree_order(const Org *org) {
         print_node(org->left_hand);
         
         // Print Left Supports
-        Node *support = org->left_hand->supports_head;
-        while (support != NULL) {
-            print_node(support);
-            support = support->next;
+        for (size_t i = 0; i < org->left_hand->support_count; i++) {
+            print_node(org->left_hand->supports[i]);
         }
     }
     
@@ -203,31 +459,74 @@ void print_tree_order(const Org *org) {
         print_node(org->right_hand);
         
         // Print Right Supports
-        Node *support = org->right_hand->supports_head;
-        while (support != NULL) {
-            print_node(support);
-            support = support->next;
+        for (size_t i = 0; i < org->right_hand->support_count; i++) {
+            print_node(org->right_hand->supports[i]);
+        }
+    }
+}
+
+// Helper function to find a fingerprint in a hand and then its supports
+static const Node *find_in_hand(const Node *hand, uint64_t fingerprint) {
+    if (hand == NULL) return NULL;
+    
+    if (hand->fingerprint == fingerprint) {
+        return hand;
+    }
+    for (size_t i = 0; i < hand->support_count; i++) {
+        if (hand->supports[i]->fingerprint == fingerprint) {
+            return hand->supports[i];
+        }
+    }
+    return NULL;
+}
+
+const Node *org_find_by_fingerprint(const Org *org, uint64_t fingerprint) {
+    if (org == NULL || fingerprint == 0) return NULL;
+    
+    // Unindexed tree: walk it in print order
+    if (org->index.slots == NULL) {
+        if (org->boss != NULL && org->boss->fingerprint == fingerprint) {
+            return org->boss;
         }
+        const Node *node = find_in_hand(org->left_hand, fingerprint);
+        return node != NULL ? node : find_in_hand(org->right_hand, fingerprint);
     }
+    
+    size_t mask = org->index.capacity - 1;
+    size_t slot = hash_fingerprint(fingerprint) & mask;
+    while (org->index.slots[slot].fingerprint != 0) {
+        if (org->index.slots[slot].fingerprint == fingerprint) {
+            return org->index.slots[slot].node;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return NULL;
 }
 
 void free_org(Org *org) {
     if (org == NULL) return;
     
-    // Free Left Hand and its supports
+    // Only the hands own memory besides the slabs: their support arrays
     if (org->left_hand != NULL) {
-        free_list(org->left_hand->supports_head);
-        free(org->left_hand);
+        free(org->left_hand->supports);
     }
-    
-    // Free Right Hand and its supports
     if (org->right_hand != NULL) {
-        free_list(org->right_hand->supports_head);
-        free(org->right_hand);
+        free(org->right_hand->supports);
     }
     
-    // Free Boss
-    if (org->boss != NULL) {
-        free(org->boss);
+    // Release every node at once, a slab at a time
+    while (org->slabs != NULL) {
+        NodeSlab *prev = org->slabs->prev;
+        free(org->slabs);
+        org->slabs = prev;
     }
-}
\ No newline at end of file
+    
+    // Free the names the nodes pointed to, and the index
+    string_pool_free(&org->names);
+    free(org->index.slots);
+    org->index.slots = NULL;
+    org->index.capacity = 0;
+    org->boss = NULL;
+    org->left_hand = NULL;
+    org->right_hand = NULL;
+}
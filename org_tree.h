@@ -1,35 +1,79 @@
 #ifndef ORG_TREE_H
 #define ORG_TREE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "entry.h"
+#include "fingerprint.h"
+#include "string_pool.h"
+
+/* Longest name kept, including the terminator; longer ones are cut. */
 #define MAX_FIELD 128
-#define MAX_POS   32
 
 typedef struct Node Node;
+typedef struct NodeSlab NodeSlab;
 
 struct Node {
-    char first[MAX_FIELD];
-    char second[MAX_FIELD];
-    char fingerprint[MAX_FIELD];
-    char position[MAX_POS];
+    // Names, interned in the Org's name pool
+    const char *first;
+    const char *second;
 
     // Tree pointers (used for Boss / Hands)
     Node *left;   // Boss->Left Hand
     Node *right;  // Boss->Right Hand
 
-    // Support list head (used for Hands)
-    Node *supports_head;
+    // Supports in file order (used for Hands), a growable array
+    Node **supports;
+    size_t support_count;
+    size_t support_capacity;
 
-    // Next pointer (used only when node is in a supports linked list)
-    Node *next;
+    uint64_t fingerprint;   // packed, see fingerprint.h
+    uint8_t position;       // PositionType
 };
 
+/* Open-addressing map from packed fingerprint to node; a 0 key marks an
+   empty slot. */
+typedef struct {
+    uint64_t fingerprint;
+    Node *node;
+} NodeIndexSlot;
+
+typedef struct {
+    NodeIndexSlot *slots;   // NULL if the index was not built
+    size_t capacity;        // power of two
+} NodeIndex;
+
 typedef struct {
     Node *boss;
     Node *left_hand;
     Node *right_hand;
+    NodeSlab *slabs;        // every node, in file order (newest slab first)
+    StringPool names;       // first and second names of every node
+    NodeIndex index;        // every node by fingerprint
 } Org;
 
+/* Writes the node's fingerprint as text (FINGERPRINT_LEN characters and a
+   terminator) to out. */
+static inline void node_fingerprint(const Node *node, char *out) {
+    unpack_fingerprint(node->fingerprint, out);
+}
+
+/* Reads a clean file written by ex1, as text or in the binary format of
+   clean_binary.h. Records whose fingerprint is not FINGERPRINT_LEN
+   alphanumerics, or whose position is unknown, are left out. */
 Org build_org_from_clean_file(const char *path);
+
+/* Builds the same tree straight from ex1's records in output order (see
+   order_entries in cleaner.h), without writing and re-reading a file. Only
+   reads the entries; their text can be freed once this returns. */
+Org build_org_from_entries(const Entry *entries, size_t count);
 void print_tree_order(const Org *org);
+
+/* Returns the node with the packed fingerprint (see fingerprint.h), or NULL.
+   If several nodes share it, the first in print_tree_order order wins. Both
+   builders above index the tree, which makes this O(1); if the index could
+   not be allocated it falls back to walking the tree. */
+const Node *org_find_by_fingerprint(const Org *org, uint64_t fingerprint);
 void free_org(Org *org);
 
 #endif // ORG_TREE_H
\ No newline at end of file
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cleaner.h"
+#include "strip.h"
+#include "file_map.h"
+#include "org_tree.h"
+#include "decrypt.h"
+
+// ex1 and ex2 in one process. The records ex1 would write are handed
+// straight to the org tree instead of going through a clean file and a
+// second text parse. stdout is what ex2 prints; the latency of every stage
+// goes to stderr.
+
+typedef struct {
+    const char *name;
+    double seconds;
+} Stage;
+
+#define STAGE_COUNT 5
+
+static double clock_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report_stages(const Stage *stages, int count) {
+    double total = 0;
+    fprintf(stderr, "stage          ms\n");
+    for (int i = 0; i < count; i++) {
+        fprintf(stderr, "%-10s %9.3f\n", stages[i].name, stages[i].seconds * 1e3);
+        total += stages[i].seconds;
+    }
+    fprintf(stderr, "%-10s %9.3f\n", "total", total * 1e3);
+}
+
+int main(int argc, char **argv) {
+    const char *program = argv[0];
+    int threads = 1;
+    if (argc > 2 && strcmp(argv[1], "--threads") == 0) {
+        threads = atoi(argv[2]);
+        argv += 2;
+        argc -= 2;
+    }
+    if (argc != 4 || threads < 1 || threads > MAX_PARSE_THREADS) {
+        printf("Usage: %s [--threads N] <input_corrupted.txt> <cipher_bits.txt> <mask_start_s>\n", program);
+        return 0;
+    }
+    const char *input_path = argv[1];
+    const char *cipher_file_path = argv[2];
+    int mask_start = atoi(argv[3]);
+    
+    // A bad cipher file is found before any real work is done
+    unsigned char cipher[FINGERPRINT_LEN];
+    if (!read_cipher_file(cipher_file_path, cipher)) {
+        return 0;
+    }
+    
+    cleaner_init();
+    Stage stages[STAGE_COUNT] = {
+        {"read_clean", 0}, {"parse", 0}, {"order", 0}, {"build_org", 0}, {"decrypt", 0}
+    };
+    double mark = clock_seconds();
+    double now;
+    
+    // Stage 1: strip the corruption into a cleaned copy
+    MappedFile input;
+    if (!map_file(input_path, &input)) {
+        printf("Error opening file: %s\n", input_path);
+        return 0;
+    }
+    char *cleaned = (char *)alloc_huge_buffer(input.size + 1);
+    if (cleaned == NULL) {
+        printf("Memory allocation failed\n");
+        unmap_file(&input);
+        return 0;
+    }
+    size_t cleaned_len = strip_corruption(input.data, input.size, cleaned);
+    cleaned[cleaned_len] = '\0';
+    unmap_file(&input);
+    now = clock_seconds();
+    stages[0].seconds = now - mark;
+    mark = now;
+    
+    // Stage 2: parse and deduplicate
+    EntryList list;
+    int parsed = threads > 1 ? parse_entries_parallel(cleaned, cleaned_len, &list, threads)
+                             : parse_entries(cleaned, cleaned_len, &list);
+    if (!parsed) {
+        free(cleaned);
+        return 0;
+    }
+    now = clock_seconds();
+    stages[1].seconds = now - mark;
+    mark = now;
+    
+    // Stage 3: the order ex1 writes the records in
+    Entry *ordered = order_entries(list.entries, list.count);
+    if (ordered == NULL) {
+        free_entry_list(&list);
+        free(cleaned);
+        return 0;
+    }
+    list.entries = ordered;
+    now = clock_seconds();
+    stages[2].seconds = now - mark;
+    mark = now;
+    
+    // Stage 4: the tree, copied out of the records so their text can go
+    Org org = build_org_from_entries(list.entries, (size_t)list.count);
+    free_entry_list(&list);
+    free(cleaned);
+    now = clock_seconds();
+    stages[3].seconds = now - mark;
+    mark = now;
+    if (org.boss == NULL) {
+        printf("No Boss found in %s\n", input_path);
+        free_org(&org);
+        report_stages(stages, 4);
+        return 0;
+    }
+    
+    // Stage 5: the ex2 mask search
+    DecryptMatch match;
+    if (find_decrypt_match(&org, cipher, mask_start, &match)) {
+        print_decrypt_result(&match);
+    } else {
+        print_decrypt_result(NULL);
+    }
+    now = clock_seconds();
+    stages[4].seconds = now - mark;
+    
+    free_org(&org);
+    report_stages(stages, STAGE_COUNT);
+    return 0;
+}
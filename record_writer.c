@@ -0,0 +1,137 @@
+#include <stdlib.h>
+#include <string.h>
+#include "record_writer.h"
+#include "fingerprint.h"
+#include "strip.h"
+
+#define LITERAL(s) s, sizeof(s) - 1
+
+// Room needed for a record besides its three values
+#define RECORD_OVERHEAD 96
+
+int record_writer_init(RecordWriter *writer, FILE *fp, size_t capacity) {
+    writer->fp = fp;
+    writer->length = 0;
+    writer->capacity = capacity;
+    writer->written = 0;
+    writer->failed = 0;
+    writer->buffer = (char *)malloc(capacity);
+    return writer->buffer != NULL;
+}
+
+void record_writer_set_file(RecordWriter *writer, FILE *fp) {
+    writer->fp = fp;
+    writer->length = 0;
+    writer->written = 0;
+    writer->failed = 0;
+}
+
+int record_writer_flush(RecordWriter *writer) {
+    if (writer->length > 0 && !writer->failed) {
+        // A block this large bypasses the stdio buffer
+        if (fwrite(writer->buffer, 1, writer->length, writer->fp) != writer->length) {
+            writer->failed = 1;
+        }
+    }
+    writer->length = 0;
+    return !writer->failed;
+}
+
+int record_writer_close(RecordWriter *writer) {
+    int ok = record_writer_flush(writer);
+    free(writer->buffer);
+    writer->buffer = NULL;
+    writer->capacity = 0;
+    return ok;
+}
+
+static inline char *put_bytes(char *out, const char *bytes, size_t len) {
+    memcpy(out, bytes, len);
+    return out + len;
+}
+
+// Copy a value view, dropping the newlines (and, for views into unstripped
+// text, the corruption) left inside it
+static inline char *put_value(char *out, const char *value, size_t len) {
+    size_t start = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (value[i] == '\n' || value[i] == '\r' || corruption_table[(unsigned char)value[i]]) {
+            out = put_bytes(out, value + start, i - start);
+            start = i + 1;
+        }
+    }
+    return put_bytes(out, value + start, len - start);
+}
+
+size_t record_max_length(const Entry *entry) {
+    const char *position = position_name((PositionType)entry->pos_type);
+    size_t position_len = position ? strlen(position) : entry->position_len;
+    return RECORD_OVERHEAD + entry->first_len + entry->second_len + position_len;
+}
+
+char *format_record(char *out, const Entry *entry) {
+    const char *position = position_name((PositionType)entry->pos_type);
+    out = put_bytes(out, LITERAL("First Name: "));
+    out = put_value(out, entry->text, entry->first_len);
+    out = put_bytes(out, LITERAL("\nSecond Name: "));
+    out = put_value(out, entry->text + entry->second_offset, entry->second_len);
+    out = put_bytes(out, LITERAL("\nFingerprint: "));
+    unpack_fingerprint(entry->fingerprint, out);
+    out += FINGERPRINT_LEN;
+    out = put_bytes(out, LITERAL("\nPosition: "));
+    if (position != NULL) {
+        out = put_bytes(out, position, strlen(position));
+    } else {
+        out = put_value(out, entry->text + entry->position_offset, entry->position_len);
+    }
+    return put_bytes(out, LITERAL("\n\n"));
+}
+
+void record_writer_put(RecordWriter *writer, const Entry *entry) {
+    size_t needed = record_max_length(entry);
+    
+    if (writer->capacity - writer->length < needed) {
+        record_writer_flush(writer);
+        if (writer->capacity < needed) {
+            // A single huge record: grow the buffer for it
+            char *temp = (char *)realloc(writer->buffer, needed);
+            if (temp == NULL) {
+                writer->failed = 1;
+                return;
+            }
+            writer->buffer = temp;
+            writer->capacity = needed;
+        }
+    }
+    
+    char *out = format_record(writer->buffer + writer->length, entry);
+    writer->written += (size_t)(out - writer->buffer) - writer->length;
+    writer->length = (size_t)(out - writer->buffer);
+}
+
+void record_writer_put_bytes(RecordWriter *writer, const char *bytes, size_t len) {
+    if (writer->capacity - writer->length < len) {
+        record_writer_flush(writer);
+    }
+    if (len >= writer->capacity) {
+        // Too big to buffer: write it straight through
+        if (!writer->failed && fwrite(bytes, 1, len, writer->fp) != len) {
+            writer->failed = 1;
+        }
+    } else {
+        memcpy(writer->buffer + writer->length, bytes, len);
+        writer->length += len;
+    }
+    writer->written += len;
+}
+
+int write_records(FILE *fp, const Entry *entries, size_t count) {
+    RecordWriter writer;
+    if (!record_writer_init(&writer, fp, RECORD_WRITER_BUFFER_SIZE)) {
+        return 0;
+    }
+    for (size_t i = 0; i < count; i++) {
+        record_writer_put(&writer, &entries[i]);
+    }
+    return record_writer_close(&writer);
+}
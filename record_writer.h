@@ -0,0 +1,52 @@
+#ifndef RECORD_WRITER_H
+#define RECORD_WRITER_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "entry.h"
+
+#define RECORD_WRITER_BUFFER_SIZE (1024 * 1024)
+
+/* Formats clean records into one large buffer and writes it out in big
+   blocks. The constant labels are copied with memcpy; there is no format
+   string on the hot path. */
+typedef struct {
+    FILE *fp;
+    char *buffer;
+    size_t length;
+    size_t capacity;
+    size_t written;     /* bytes put since init or set_file */
+    int failed;         /* set once a write or an allocation failed */
+} RecordWriter;
+
+/* Upper bound on the bytes format_record writes for entry. */
+size_t record_max_length(const Entry *entry);
+
+/* Formats entry in the clean text format at out, which must have room for
+   record_max_length(entry) bytes. Returns the end of the record. */
+char *format_record(char *out, const Entry *entry);
+
+/* Starts a writer on fp with a buffer of capacity bytes. Returns 0 on
+   allocation failure. */
+int record_writer_init(RecordWriter *writer, FILE *fp, size_t capacity);
+
+/* Points a flushed writer at another file and clears its error, keeping
+   the buffer. */
+void record_writer_set_file(RecordWriter *writer, FILE *fp);
+
+/* Appends one record in the clean text format, flushing as needed. */
+void record_writer_put(RecordWriter *writer, const Entry *entry);
+
+/* Appends len raw bytes, such as a piece of an earlier output. */
+void record_writer_put_bytes(RecordWriter *writer, const char *bytes, size_t len);
+
+/* Writes out whatever is buffered. Returns 0 if any write has failed. */
+int record_writer_flush(RecordWriter *writer);
+
+/* Flushes and releases the buffer. Returns 0 if any write has failed. */
+int record_writer_close(RecordWriter *writer);
+
+/* Writes all the records to fp. Returns 0 on failure. */
+int write_records(FILE *fp, const Entry *entries, size_t count);
+
+#endif // RECORD_WRITER_H
@@ -0,0 +1,86 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "string_pool.h"
+#include "open_table.h"
+
+#define STRING_POOL_MIN_CAPACITY 64
+#define STRING_POOL_BLOCK_SIZE (64 * 1024)
+
+// FNV-1a over the bytes of the string
+static inline size_t hash_text(const char *text, size_t len) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)text[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return (size_t)hash;
+}
+
+// The lengths are compared first, so memcmp never reads past a shorter
+// pooled string
+static inline int same_text(const StringPoolSlot *pooled, const char *text, size_t len) {
+    return pooled->len == len && memcmp(pooled->text, text, len) == 0;
+}
+
+void string_pool_init(StringPool *pool) {
+    arena_init(&pool->strings, STRING_POOL_BLOCK_SIZE);
+    pool->slots = NULL;
+    pool->capacity = 0;
+    pool->count = 0;
+}
+
+static size_t hash_slot(const void *slot) {
+    const StringPoolSlot *pooled = (const StringPoolSlot *)slot;
+    return hash_text(pooled->text, pooled->len);
+}
+
+// Double the table and reinsert every string
+static int grow(StringPool *pool) {
+    size_t capacity = pool->capacity ? pool->capacity * 2 : STRING_POOL_MIN_CAPACITY;
+    StringPoolSlot *slots = (StringPoolSlot *)open_table_rehash(pool->slots, pool->capacity, capacity,
+                                                                sizeof(StringPoolSlot), hash_slot);
+    if (slots == NULL) {
+        return 0;
+    }
+    free(pool->slots);
+    pool->slots = slots;
+    pool->capacity = capacity;
+    return 1;
+}
+
+const char *string_pool_intern(StringPool *pool, const char *text, size_t len) {
+    if (open_table_full(pool->count, pool->capacity)) {
+        if (!grow(pool)) {
+            return NULL;
+        }
+    }
+
+    size_t mask = pool->capacity - 1;
+    size_t slot = hash_text(text, len) & mask;
+    while (pool->slots[slot].text != NULL) {
+        if (same_text(&pool->slots[slot], text, len)) {
+            return pool->slots[slot].text;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    char *copy = arena_alloc(&pool->strings, len + 1);
+    if (copy == NULL) {
+        return NULL;
+    }
+    memcpy(copy, text, len);
+    copy[len] = '\0';
+    pool->slots[slot].text = copy;
+    pool->slots[slot].len = len;
+    pool->count++;
+    return copy;
+}
+
+void string_pool_free(StringPool *pool) {
+    arena_free(&pool->strings);
+    free(pool->slots);
+    pool->slots = NULL;
+    pool->capacity = 0;
+    pool->count = 0;
+}
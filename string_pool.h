@@ -0,0 +1,33 @@
+#ifndef STRING_POOL_H
+#define STRING_POOL_H
+
+#include <stddef.h>
+#include "arena.h"
+
+/* A pooled string and its length; an empty slot is all zero. */
+typedef struct {
+    const char *text;
+    size_t len;
+} StringPoolSlot;
+
+/* Interned NUL-terminated strings. Each distinct string is stored once, in
+   an arena, and every intern of an equal string returns the same pointer,
+   valid until string_pool_free. */
+typedef struct {
+    Arena strings;
+    StringPoolSlot *slots;  /* open addressing */
+    size_t capacity;        /* power of two, 0 until the first intern */
+    size_t count;
+} StringPool;
+
+/* Initializes an empty pool; nothing is allocated until the first intern. */
+void string_pool_init(StringPool *pool);
+
+/* Returns the pooled copy of text[0..len), adding it if it is new, or NULL
+   on allocation failure. */
+const char *string_pool_intern(StringPool *pool, const char *text, size_t len);
+
+/* Releases every string of the pool. */
+void string_pool_free(StringPool *pool);
+
+#endif // STRING_POOL_H
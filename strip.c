@@ -0,0 +1,179 @@
+#include "strip.h"
+#include <stdint.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define STRIP_X86 1
+#include <immintrin.h>
+#endif
+
+typedef size_t (*strip_fn)(const char *src, size_t n, char *dst);
+
+static strip_fn selected_kernel = NULL;
+static const char *selected_name = "scalar";
+
+const unsigned char corruption_table[256] = {
+    ['#'] = 1, ['?'] = 1, ['!'] = 1, ['@'] = 1, ['&'] = 1, ['$'] = 1
+};
+
+int is_corruption(char c) {
+    return (c == '#' || c == '?' || c == '!' || c == '@' || c == '&' || c == '$');
+}
+
+size_t strip_corruption_scalar(const char *src, size_t n, char *dst) {
+    size_t j = 0;
+    for (size_t i = 0; i < n; i++) {
+        dst[j] = src[i];
+        j += !is_corruption(src[i]);
+    }
+    return j;
+}
+
+#ifdef STRIP_X86
+
+// shuffle_table[m] gathers the bytes whose bit is set in m to the front of an
+// 8-byte group; the unused lanes are zeroed (0x80) and get overwritten later
+static uint8_t shuffle_table[256][16];
+static uint8_t keep_count[256];
+
+static void build_shuffle_table(void) {
+    for (int m = 0; m < 256; m++) {
+        int k = 0;
+        for (int bit = 0; bit < 8; bit++) {
+            if (m & (1 << bit)) {
+                shuffle_table[m][k++] = (uint8_t)bit;
+            }
+        }
+        keep_count[m] = (uint8_t)k;
+        while (k < 16) {
+            shuffle_table[m][k++] = 0x80;
+        }
+    }
+}
+
+// Compact one 8-byte group (the low half of v) according to keep, returns
+// the number of bytes written. Writes 8 bytes, of which only the kept count
+// are meaningful.
+__attribute__((target("ssse3")))
+static inline size_t compact8(__m128i v, unsigned keep, char *dst) {
+    __m128i shuffle = _mm_loadu_si128((const __m128i *)shuffle_table[keep]);
+    _mm_storel_epi64((__m128i *)dst, _mm_shuffle_epi8(v, shuffle));
+    return keep_count[keep];
+}
+
+__attribute__((target("sse4.2")))
+size_t strip_corruption_sse42(const char *src, size_t n, char *dst) {
+    const __m128i set = _mm_setr_epi8('#', '?', '!', '@', '&', '$',
+                                      0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    size_t i = 0, j = 0;
+    
+    // j never passes i, so the 16-byte stores stay inside dst[0..n)
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i hits = _mm_cmpestrm(set, 6, v, 16,
+                                    _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_BIT_MASK);
+        unsigned keep = ~(unsigned)_mm_cvtsi128_si32(hits) & 0xFFFF;
+        
+        if (keep == 0xFFFF) {
+            _mm_storeu_si128((__m128i *)(dst + j), v);
+            j += 16;
+            continue;
+        }
+        j += compact8(v, keep & 0xFF, dst + j);
+        j += compact8(_mm_srli_si128(v, 8), keep >> 8, dst + j);
+    }
+    
+    return j + strip_corruption_scalar(src + i, n - i, dst + j);
+}
+
+__attribute__((target("avx2")))
+size_t strip_corruption_avx2(const char *src, size_t n, char *dst) {
+    const __m256i c0 = _mm256_set1_epi8('#');
+    const __m256i c1 = _mm256_set1_epi8('?');
+    const __m256i c2 = _mm256_set1_epi8('!');
+    const __m256i c3 = _mm256_set1_epi8('@');
+    const __m256i c4 = _mm256_set1_epi8('&');
+    const __m256i c5 = _mm256_set1_epi8('$');
+    size_t i = 0, j = 0;
+    
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i hits = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, c0), _mm256_cmpeq_epi8(v, c1)),
+            _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, c2), _mm256_cmpeq_epi8(v, c3)),
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, c4), _mm256_cmpeq_epi8(v, c5))));
+        uint32_t keep = ~(uint32_t)_mm256_movemask_epi8(hits);
+        
+        if (keep == 0xFFFFFFFFu) {
+            _mm256_storeu_si256((__m256i *)(dst + j), v);
+            j += 32;
+            continue;
+        }
+        __m128i lo = _mm256_castsi256_si128(v);
+        __m128i hi = _mm256_extracti128_si256(v, 1);
+        j += compact8(lo, keep & 0xFF, dst + j);
+        j += compact8(_mm_srli_si128(lo, 8), (keep >> 8) & 0xFF, dst + j);
+        j += compact8(hi, (keep >> 16) & 0xFF, dst + j);
+        j += compact8(_mm_srli_si128(hi, 8), keep >> 24, dst + j);
+    }
+    
+    return j + strip_corruption_sse42(src + i, n - i, dst + j);
+}
+
+int strip_have_sse42(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("ssse3");
+}
+
+int strip_have_avx2(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && strip_have_sse42();
+}
+
+#else
+
+size_t strip_corruption_sse42(const char *src, size_t n, char *dst) {
+    return strip_corruption_scalar(src, n, dst);
+}
+
+size_t strip_corruption_avx2(const char *src, size_t n, char *dst) {
+    return strip_corruption_scalar(src, n, dst);
+}
+
+int strip_have_sse42(void) {
+    return 0;
+}
+
+int strip_have_avx2(void) {
+    return 0;
+}
+
+#endif
+
+void strip_init(void) {
+    if (selected_kernel != NULL) return;
+    
+#ifdef STRIP_X86
+    build_shuffle_table();
+#endif
+    if (strip_have_avx2()) {
+        selected_name = "avx2";
+        selected_kernel = strip_corruption_avx2;
+    } else if (strip_have_sse42()) {
+        selected_name = "sse4.2";
+        selected_kernel = strip_corruption_sse42;
+    } else {
+        selected_name = "scalar";
+        selected_kernel = strip_corruption_scalar;
+    }
+}
+
+const char *strip_kernel_name(void) {
+    strip_init();
+    return selected_name;
+}
+
+size_t strip_corruption(const char *src, size_t n, char *dst) {
+    strip_init();
+    return selected_kernel(src, n, dst);
+}
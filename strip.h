@@ -0,0 +1,34 @@
+#ifndef STRIP_H
+#define STRIP_H
+
+#include <stddef.h>
+
+/* Returns 1 if c is one of the corruption characters #?!@&$, 0 otherwise. */
+int is_corruption(char c);
+
+/* Same test as a table indexed by (unsigned char)c, for hot loops that skip
+   corruption in place instead of stripping it first. */
+extern const unsigned char corruption_table[256];
+
+/* Copies src[0..n) into dst, dropping corruption characters, and returns the
+   number of bytes written. dst must have room for n bytes and must not
+   overlap src. Uses the fastest kernel this CPU supports. */
+size_t strip_corruption(const char *src, size_t n, char *dst);
+
+/* Selects the kernel used by strip_corruption. Called automatically on first
+   use; call it once at startup before starting any threads. */
+void strip_init(void);
+
+/* Name of the selected kernel: "avx2", "sse4.2" or "scalar". */
+const char *strip_kernel_name(void);
+
+/* The individual kernels, for benchmarking and cross-checking. The vector
+   kernels may only be called after strip_init, and only when the matching
+   strip_have_* returns 1. */
+size_t strip_corruption_scalar(const char *src, size_t n, char *dst);
+size_t strip_corruption_sse42(const char *src, size_t n, char *dst);
+size_t strip_corruption_avx2(const char *src, size_t n, char *dst);
+int    strip_have_sse42(void);
+int    strip_have_avx2(void);
+
+#endif // STRIP_H
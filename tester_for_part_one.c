@@ -2,6 +2,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include "cleaner.h"
+#include "org_tree.h"
 
 // Test result tracking
 int tests_passed = 0;
@@ -93,6 +95,304 @@ void assert_test(int condition, const char *test_name) {
     }
 }
 
+// Run ex1 with flags before (or instead of) the usual two paths
+int run_ex1_args(const char *args) {
+    char cmd[1024];
+    sprintf(cmd, ".\\ex1.exe %s", args);
+    return system(cmd);
+}
+
+// Deterministic random numbers for the generated inputs
+unsigned int test_rand_state = 1;
+
+unsigned int test_rand(void) {
+    test_rand_state = test_rand_state * 1103515245u + 12345u;
+    return (test_rand_state >> 16) & 0x7fff;
+}
+
+// Append text to buf, putting a corruption character after about one byte
+// in ten
+void append_corrupted(char *buf, size_t *len, const char *text) {
+    static const char corruption[] = "#?!@&$";
+    for (const char *p = text; *p != '\0'; p++) {
+        buf[(*len)++] = *p;
+        if (test_rand() % 10 == 0) {
+            buf[(*len)++] = corruption[test_rand() % 6];
+        }
+    }
+    buf[*len] = '\0';
+}
+
+// Generate records first .. first + count - 1 of a corrupted dump. Each
+// record depends only on the seed and its number, so the records of a
+// range read exactly like that part of the whole dump. The records mix
+// every position (and an unknown one), repeated and malformed
+// fingerprints, labels broken over lines and names holding a label; with
+// messy set, some records are also cut short.
+char* generate_records(int first, int count, unsigned int seed, int messy) {
+    static const char *names[] = {"John", "Jane", "Bob", "Alice", "Charlie", "Dana", "Eve", "Frank"};
+    static const char *positions[] = {"Boss", "Right Hand", "Left Hand", "Support_Right", "Support_Left",
+                                      "Support Right", "Manager"};
+    static const char alnum[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+    char *buf = malloc((size_t)count * 512 + 1);
+    size_t len = 0;
+    buf[0] = '\0';
+    
+    for (int i = first; i < first + count; i++) {
+        test_rand_state = seed * 7919u + (unsigned int)i;
+        char record[256], fingerprint[16];
+        
+        int kind = test_rand() % 10;
+        if (kind < 6) {
+            for (int k = 0; k < 9; k++) fingerprint[k] = alnum[test_rand() % 62];
+            fingerprint[9] = '\0';
+        } else if (kind < 9) {
+            sprintf(fingerprint, "DUP%06u", test_rand() % 40);
+        } else {
+            sprintf(fingerprint, "BAD%u", test_rand() % 1000);
+        }
+        
+        sprintf(record, "%s %s\n%s %s%s\n%s %s\n%s %s\n\n",
+                test_rand() % 5 == 0 ? "Fir\nst Na\nme:" : "First Name:",
+                names[test_rand() % 8],
+                test_rand() % 5 == 0 ? "Sec\nond Name:" : "Second Name:",
+                names[test_rand() % 8],
+                test_rand() % 4 == 0 ? " FirstName: Hidden" : "",
+                "Fingerprint:", fingerprint,
+                "Position:", positions[test_rand() % 7]);
+        if (messy && test_rand() % 40 == 0) {
+            record[test_rand() % strlen(record)] = '\0';
+        }
+        append_corrupted(buf, &len, record);
+    }
+    return buf;
+}
+
+// Generate count records that each have their own fingerprint and names,
+// the names of many lengths, so that loading their clean file interns far
+// more text than one string-pool block holds. Most records are supports;
+// ex1 writes them after the hands, so the loaded tree holds nearly all of
+// them.
+char* generate_named_records(int count) {
+    static const char alnum[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+    static const char letters[] = "abcdefghijklmnopqrstuvwxyz";
+    char *buf = malloc((size_t)count * 256 + 1);
+    size_t len = 0;
+    buf[0] = '\0';
+    test_rand_state = 4242;
+    
+    for (int i = 0; i < count; i++) {
+        char record[256], fingerprint[16];
+        int n = i;
+        for (int k = 8; k >= 0; k--) {
+            fingerprint[k] = alnum[n % 62];
+            n /= 62;
+        }
+        fingerprint[9] = '\0';
+        
+        const char *position = i % 2 ? "Support_Right" : "Support_Left";
+        if (i % 1000 == 0) position = "Right Hand";
+        else if (i % 1000 == 500) position = "Left Hand";
+        else if (i % 997 == 0) position = "Boss";
+        
+        int first_len = 1 + test_rand() % 20;
+        int second_len = 1 + test_rand() % 20;
+        sprintf(record, "First Name: N%.*s%d\nSecond Name: S%.*s%d\nFingerprint: %s\nPosition: %s\n\n",
+                first_len, letters, i, second_len, letters + 26 - second_len, i, fingerprint, position);
+        append_corrupted(buf, &len, record);
+    }
+    return buf;
+}
+
+// One record of a text clean file, pointing into the file's content
+typedef struct {
+    const char *first;
+    const char *second;
+    const char *fingerprint;
+    const char *position;
+} CleanRecord;
+
+// Helper to compare a node with a record of the clean text, and to check
+// that a lookup by its fingerprint finds it
+int node_matches_record(const Org *org, const Node *node, const CleanRecord *record) {
+    char fingerprint[FINGERPRINT_LEN + 1];
+    if (node == NULL) return 0;
+    node_fingerprint(node, fingerprint);
+    return strcmp(node->first, record->first) == 0 && strcmp(node->second, record->second) == 0 &&
+           strcmp(fingerprint, record->fingerprint) == 0 &&
+           strcmp(position_name((PositionType)node->position), record->position) == 0 &&
+           org_find_by_fingerprint(org, node->fingerprint) == node;
+}
+
+// Helper to compare a hand and its supports with the records of the clean
+// text: the last hand record, and the support records after it
+int hand_matches_records(const Org *org, const Node *hand, const CleanRecord *records, size_t count,
+                         const char *hand_name, const char *support_name) {
+    size_t last = count;
+    for (size_t i = 0; i < count; i++) {
+        if (strcmp(records[i].position, hand_name) == 0) last = i;
+    }
+    if (last == count) return hand == NULL;
+    if (!node_matches_record(org, hand, &records[last])) return 0;
+    
+    size_t support = 0;
+    for (size_t i = last + 1; i < count; i++) {
+        if (strcmp(records[i].position, support_name) != 0) continue;
+        if (support >= hand->support_count ||
+            !node_matches_record(org, hand->supports[support], &records[i])) {
+            return 0;
+        }
+        support++;
+    }
+    return support == hand->support_count;
+}
+
+// Helper to check a loaded tree against the text clean file it came from,
+// read here line by line: the last Boss and hands win, and each hand keeps
+// the supports that follow it. *record_count gets the number of records.
+int org_matches_clean_text(const Org *org, const char *path, size_t *record_count) {
+    char *content = read_file(path);
+    *record_count = 0;
+    if (!content) return 0;
+    
+    size_t capacity = 1024, count = 0;
+    CleanRecord *records = malloc(capacity * sizeof(CleanRecord));
+    CleanRecord current = {"", "", "", ""};
+    for (char *line = content; *line != '\0'; ) {
+        char *eol = strchr(line, '\n');
+        char *next = eol ? eol + 1 : line + strlen(line);
+        if (eol) *eol = '\0';
+        
+        if (strncmp(line, "First Name: ", 12) == 0) current.first = line + 12;
+        else if (strncmp(line, "Second Name: ", 13) == 0) current.second = line + 13;
+        else if (strncmp(line, "Fingerprint: ", 13) == 0) current.fingerprint = line + 13;
+        else if (strncmp(line, "Position: ", 10) == 0) {
+            current.position = line + 10;
+            if (count == capacity) {
+                capacity *= 2;
+                records = realloc(records, capacity * sizeof(CleanRecord));
+            }
+            records[count++] = current;
+        }
+        line = next;
+    }
+    
+    size_t last_boss = count;
+    for (size_t i = 0; i < count; i++) {
+        if (strcmp(records[i].position, "Boss") == 0) last_boss = i;
+    }
+    int match = (last_boss == count ? org->boss == NULL : node_matches_record(org, org->boss, &records[last_boss])) &&
+                hand_matches_records(org, org->right_hand, records, count, "Right Hand", "Support_Right") &&
+                hand_matches_records(org, org->left_hand, records, count, "Left Hand", "Support_Left");
+    *record_count = count;
+    free(records);
+    free(content);
+    return match;
+}
+
+// Helper to check that two metrics files report the same counters; the
+// stage times, mode and reallocation count may differ between modes
+int metrics_counters_match(const char *file1, const char *file2) {
+    static const char *keys[] = {"\"bytes_read\":", "\"bytes_stripped\":", "\"records_seen\":",
+                                 "\"duplicates_dropped\":", "\"bad_fingerprints\":", "\"records_written\":"};
+    char *content1 = read_file(file1);
+    char *content2 = read_file(file2);
+    
+    if (!content1 || !content2) {
+        if (content1) free(content1);
+        if (content2) free(content2);
+        return 0;
+    }
+    
+    int match = 1;
+    for (int k = 0; k < 6; k++) {
+        char *value1 = strstr(content1, keys[k]);
+        char *value2 = strstr(content2, keys[k]);
+        if (!value1 || !value2 ||
+            strtoull(value1 + strlen(keys[k]), NULL, 10) != strtoull(value2 + strlen(keys[k]), NULL, 10)) {
+            match = 0;
+        }
+    }
+    free(content1);
+    free(content2);
+    return match;
+}
+
+// Helper to run ex1 with flags on input and compare its output with the
+// default path's output for the same input
+int mode_matches_default(const char *flags, const char *input, const char *expected) {
+    char args[512];
+    remove("test_data/mode_output.txt");
+    sprintf(args, "%s %s test_data/mode_output.txt", flags, input);
+    run_ex1_args(args);
+    return files_match("test_data/mode_output.txt", expected);
+}
+
+// Helper to compare two nodes of two trees, either of which may be missing
+int nodes_match(const Node *a, const Node *b) {
+    if (a == NULL || b == NULL) return a == b;
+    return strcmp(a->first, b->first) == 0 && strcmp(a->second, b->second) == 0 &&
+           a->fingerprint == b->fingerprint && a->position == b->position;
+}
+
+// Helper to compare two hands and their supports, in order
+int hands_match(const Node *a, const Node *b) {
+    if (!nodes_match(a, b)) return 0;
+    if (a == NULL) return 1;
+    if (a->support_count != b->support_count) return 0;
+    for (size_t i = 0; i < a->support_count; i++) {
+        if (!nodes_match(a->supports[i], b->supports[i])) return 0;
+    }
+    return 1;
+}
+
+// Helper to load two clean files with build_org_from_clean_file and compare
+// the trees node by node. An empty tree never matches, so a reader that
+// loads nothing cannot pass.
+int clean_files_load_alike(const char *file1, const char *file2) {
+    Org org1 = build_org_from_clean_file(file1);
+    Org org2 = build_org_from_clean_file(file2);
+    int match = org1.boss != NULL && nodes_match(org1.boss, org2.boss) &&
+                hands_match(org1.left_hand, org2.left_hand) &&
+                hands_match(org1.right_hand, org2.right_hand);
+    free_org(&org1);
+    free_org(&org2);
+    return match;
+}
+
+// Allocator for the cleaning library that counts its allocations and how
+// many of them are still held
+typedef struct {
+    size_t allocations;
+    size_t live;
+} AllocationCount;
+
+void *counting_alloc(size_t size, void *context) {
+    AllocationCount *count = (AllocationCount *)context;
+    void *ptr = malloc(size);
+    if (ptr != NULL) {
+        count->allocations++;
+        count->live++;
+    }
+    return ptr;
+}
+
+void counting_release(void *ptr, void *context) {
+    AllocationCount *count = (AllocationCount *)context;
+    count->live--;
+    free(ptr);
+}
+
+// Helper to count the records of a clean text by their Fingerprint lines;
+// a value may hold the label too, but never at the start of a line
+size_t count_clean_records(const char *text) {
+    size_t count = 0;
+    for (const char *p = strstr(text, "\nFingerprint: "); p != NULL; p = strstr(p + 1, "\nFingerprint: ")) {
+        count++;
+    }
+    return count;
+}
+
 // Generate all test files
 void generate_test_files() {
     ensure_directory("test_data");
@@ -598,6 +898,312 @@ void run_tests() {
     }
 }
 
+void run_mode_tests() {
+    // Generated dumps, and what the default path makes of them
+    for (int i = 1; i <= 5; i++) {
+        char input[64], output[64];
+        sprintf(input, "test_data/modes_input%d.txt", i);
+        sprintf(output, "test_data/modes_default%d.txt", i);
+        char *content = generate_records(0, 1500, (unsigned int)(100 + i), 1);
+        write_test_file(input, content);
+        free(content);
+        run_ex1(input, output);
+    }
+    
+    // Every parse mode must write what the default path writes
+    printf("\n=== Parallel Parse Tests ===\n");
+    
+    for (int i = 1; i <= 10; i++) {
+        char input[64], expected[64], test_name[128];
+        sprintf(input, "test_data/input%02d.txt", i);
+        sprintf(expected, "test_data/output%02d.txt", i);
+        sprintf(test_name, "--threads 4 matches default, core input %d", i);
+        assert_test(mode_matches_default("--threads 4", input, expected), test_name);
+    }
+    for (int i = 1; i <= 5; i++) {
+        char input[64], expected[64], test_name[128];
+        sprintf(input, "test_data/modes_input%d.txt", i);
+        sprintf(expected, "test_data/modes_default%d.txt", i);
+        sprintf(test_name, "--threads 4 matches default, generated input %d", i);
+        assert_test(mode_matches_default("--threads 4", input, expected), test_name);
+        sprintf(test_name, "--threads 16 matches default, generated input %d", i);
+        assert_test(mode_matches_default("--threads 16", input, expected), test_name);
+    }
+    
+    printf("\n=== Streaming Tests ===\n");
+    
+    for (int i = 1; i <= 10; i++) {
+        char input[64], expected[64], test_name[128];
+        sprintf(input, "test_data/input%02d.txt", i);
+        sprintf(expected, "test_data/output%02d.txt", i);
+        sprintf(test_name, "--stream matches default, core input %d", i);
+        assert_test(mode_matches_default("--stream", input, expected), test_name);
+    }
+    for (int i = 1; i <= 5; i++) {
+        char input[64], expected[64], args[256], test_name[128];
+        sprintf(input, "test_data/modes_input%d.txt", i);
+        sprintf(expected, "test_data/modes_default%d.txt", i);
+        sprintf(test_name, "--stream matches default, generated input %d", i);
+        assert_test(mode_matches_default("--stream", input, expected), test_name);
+        
+        // "-" streams standard input
+        remove("test_data/mode_output.txt");
+        sprintf(args, "- test_data/mode_output.txt < %s", input);
+        run_ex1_args(args);
+        sprintf(test_name, "Streaming from stdin matches default, generated input %d", i);
+        assert_test(files_match("test_data/mode_output.txt", expected), test_name);
+    }
+    
+    printf("\n=== Fused Parse Tests ===\n");
+    
+    for (int i = 1; i <= 10; i++) {
+        char input[64], expected[64], test_name[128];
+        sprintf(input, "test_data/input%02d.txt", i);
+        sprintf(expected, "test_data/output%02d.txt", i);
+        sprintf(test_name, "--fused matches default, core input %d", i);
+        assert_test(mode_matches_default("--fused", input, expected), test_name);
+    }
+    for (int i = 1; i <= 5; i++) {
+        char input[64], expected[64], test_name[128];
+        sprintf(input, "test_data/modes_input%d.txt", i);
+        sprintf(expected, "test_data/modes_default%d.txt", i);
+        sprintf(test_name, "--fused matches default, generated input %d", i);
+        assert_test(mode_matches_default("--fused", input, expected), test_name);
+        sprintf(test_name, "--fused --threads 4 matches default, generated input %d", i);
+        assert_test(mode_matches_default("--fused --threads 4", input, expected), test_name);
+    }
+    
+    // Appending in pieces, cut anywhere, must end where a full run does
+    printf("\n=== Incremental Tests ===\n");
+    
+    for (int i = 1; i <= 5; i++) {
+        char expected[64], test_name[128];
+        sprintf(expected, "test_data/modes_default%d.txt", i);
+        char *content = generate_records(0, 1500, (unsigned int)(100 + i), 1);
+        size_t len = strlen(content);
+        remove("test_data/incremental_output.txt");
+        remove("test_data/incremental_output.txt.state");
+        
+        for (int part = 1; part <= 3; part++) {
+            size_t cut = len * part / 3 - (part < 3 ? (size_t)(i * 17) : 0);
+            char saved = content[cut];
+            content[cut] = '\0';
+            write_test_file("test_data/incremental_input.txt", content);
+            content[cut] = saved;
+            run_ex1_args("--incremental test_data/incremental_input.txt test_data/incremental_output.txt");
+        }
+        free(content);
+        sprintf(test_name, "--incremental in three appends matches default, generated input %d", i);
+        assert_test(files_match("test_data/incremental_output.txt", expected), test_name);
+        
+        // A run with nothing appended must leave the output as it is
+        run_ex1_args("--incremental test_data/incremental_input.txt test_data/incremental_output.txt");
+        sprintf(test_name, "--incremental with nothing appended, generated input %d", i);
+        assert_test(files_match("test_data/incremental_output.txt", expected), test_name);
+    }
+    
+    // Shards cleaned on their own and merged must give the whole dump's output
+    printf("\n=== Merge Tests ===\n");
+    
+    for (int i = 1; i <= 5; i++) {
+        char test_name[128];
+        char *content = generate_records(0, 1200, (unsigned int)(300 + i), 0);
+        write_test_file("test_data/merge_input.txt", content);
+        free(content);
+        run_ex1("test_data/merge_input.txt", "test_data/merge_whole.txt");
+        
+        // Uneven shards, split at record boundaries
+        int bounds[4] = {0, 100 * i, 700, 1200};
+        for (int k = 0; k < 3; k++) {
+            char input[64], output[64];
+            sprintf(input, "test_data/merge_shard%d.txt", k);
+            sprintf(output, "test_data/merge_shard%d_clean.txt", k);
+            content = generate_records(bounds[k], bounds[k + 1] - bounds[k], (unsigned int)(300 + i), 0);
+            write_test_file(input, content);
+            free(content);
+            run_ex1(input, output);
+        }
+        remove("test_data/merge_output.txt");
+        run_ex1_args("--merge test_data/merge_output.txt test_data/merge_shard0_clean.txt "
+                     "test_data/merge_shard1_clean.txt test_data/merge_shard2_clean.txt");
+        sprintf(test_name, "--merge of three shards matches the whole dump (%d)", i);
+        assert_test(files_match("test_data/merge_output.txt", "test_data/merge_whole.txt"), test_name);
+    }
+    
+    // The binary clean format must load into the same tree as the text one
+    printf("\n=== Binary Clean File Tests ===\n");
+    
+    for (int i = 1; i <= 5; i++) {
+        char input[64], text[64], args[256], test_name[128];
+        sprintf(input, "test_data/modes_input%d.txt", i);
+        sprintf(text, "test_data/modes_default%d.txt", i);
+        sprintf(args, "--binary %s test_data/binary_output.bin", input);
+        remove("test_data/binary_output.bin");
+        run_ex1_args(args);
+        sprintf(test_name, "Binary and text clean files load alike, generated input %d", i);
+        assert_test(clean_files_load_alike("test_data/binary_output.bin", text), test_name);
+    }
+    
+    // Every file of a batch must come out as a single-file run writes it
+    printf("\n=== Batch Tests ===\n");
+    
+    ensure_directory("test_data/batch_in");
+    ensure_directory("test_data/batch_out");
+    ensure_directory("test_data/batch_manifest_out");
+    for (int i = 1; i <= 5; i++) {
+        char input[64], output[64];
+        sprintf(input, "test_data/batch_in/batch%d.txt", i);
+        char *content = generate_records(0, 1500, (unsigned int)(100 + i), 1);
+        write_test_file(input, content);
+        free(content);
+        sprintf(output, "test_data/batch_out/batch%d.txt", i);
+        remove(output);
+        sprintf(output, "test_data/batch_manifest_out/modes_input%d.txt", i);
+        remove(output);
+    }
+    
+    run_ex1_args("--threads 3 --batch test_data/batch_in test_data/batch_out > test_data/batch_log.txt");
+    for (int i = 1; i <= 5; i++) {
+        char output[64], expected[64], test_name[128];
+        sprintf(output, "test_data/batch_out/batch%d.txt", i);
+        sprintf(expected, "test_data/modes_default%d.txt", i);
+        sprintf(test_name, "--batch of a directory matches a single run, file %d", i);
+        assert_test(files_match(output, expected), test_name);
+    }
+    char *log = read_file("test_data/batch_log.txt");
+    assert_test(log != NULL && strstr(log, "Cleaned") == NULL, "--batch of a directory cleans every file");
+    free(log);
+    
+    // A manifest names the inputs, one per line; a missing one is reported
+    // and the rest are still cleaned
+    write_test_file("test_data/batch_manifest.txt",
+        "test_data/modes_input1.txt\n"
+        "test_data/modes_input2.txt\n"
+        "\n"
+        "test_data/missing_input.txt\n"
+        "test_data/modes_input3.txt\n"
+        "test_data/modes_input4.txt\n"
+        "test_data/modes_input5.txt\n");
+    run_ex1_args("--threads 2 --batch test_data/batch_manifest.txt test_data/batch_manifest_out > test_data/batch_log.txt");
+    for (int i = 1; i <= 5; i++) {
+        char output[64], expected[64], test_name[128];
+        sprintf(output, "test_data/batch_manifest_out/modes_input%d.txt", i);
+        sprintf(expected, "test_data/modes_default%d.txt", i);
+        sprintf(test_name, "--batch of a manifest matches a single run, file %d", i);
+        assert_test(files_match(output, expected), test_name);
+    }
+    log = read_file("test_data/batch_log.txt");
+    assert_test(log != NULL && strstr(log, "Cleaned 5 of 6 files") != NULL,
+                "--batch of a manifest reports its missing input");
+    free(log);
+    
+    // The in-memory library must give ex1's output and hand back, through
+    // the caller's allocator, everything it took from it
+    printf("\n=== Library Tests ===\n");
+    
+    cleaner_init();
+    for (int i = 1; i <= 5; i++) {
+        char input[64], expected[64], test_name[128];
+        sprintf(input, "test_data/modes_input%d.txt", i);
+        sprintf(expected, "test_data/modes_default%d.txt", i);
+        char *input_text = read_file(input);
+        char *expected_text = read_file(expected);
+        
+        for (int threads = 1; threads <= 4; threads += 3) {
+            AllocationCount count = {0, 0};
+            CleanerAllocator allocator = {counting_alloc, counting_release, &count};
+            char *output = NULL;
+            size_t output_len = 0;
+            int ok = input_text != NULL && expected_text != NULL &&
+                     clean_to_buffer(input_text, strlen(input_text), threads, &allocator, &output, &output_len);
+            sprintf(test_name, "clean_to_buffer matches ex1, %d thread(s), generated input %d", threads, i);
+            assert_test(ok && output_len == strlen(expected_text) && memcmp(output, expected_text, output_len) == 0,
+                        test_name);
+            // Only the output buffer is left to the caller
+            sprintf(test_name, "clean_to_buffer releases its scratch, %d thread(s), generated input %d", threads, i);
+            assert_test(ok && count.allocations > 1 && count.live == 1, test_name);
+            if (ok) {
+                allocator.release(output, allocator.context);
+            }
+            
+            CleanResult result;
+            ok = input_text != NULL && expected_text != NULL &&
+                 clean_records(input_text, strlen(input_text), threads, &allocator, &result);
+            sprintf(test_name, "clean_records keeps ex1's records, %d thread(s), generated input %d", threads, i);
+            assert_test(ok && result.count == count_clean_records(expected_text), test_name);
+            if (ok) {
+                free_clean_result(&result, &allocator);
+            }
+            sprintf(test_name, "free_clean_result releases everything, %d thread(s), generated input %d", threads, i);
+            assert_test(ok && count.live == 0, test_name);
+        }
+        free(input_text);
+        free(expected_text);
+    }
+    
+    AllocationCount empty_count = {0, 0};
+    CleanerAllocator empty_allocator = {counting_alloc, counting_release, &empty_count};
+    char *empty_output = NULL;
+    size_t empty_len = 1;
+    int empty_ok = clean_to_buffer("", 0, 1, &empty_allocator, &empty_output, &empty_len);
+    assert_test(empty_ok && empty_len == 0 && empty_output[0] == '\0', "clean_to_buffer of empty input");
+    if (empty_ok) {
+        empty_allocator.release(empty_output, empty_allocator.context);
+    }
+    assert_test(empty_count.live == 0, "clean_to_buffer of empty input releases everything");
+    
+    // Far more names than one string-pool block holds; build the tester with
+    // -fsanitize=address (see README.md) to catch reads past a block
+    printf("\n=== Large Org Tree Tests ===\n");
+    
+    char *named = generate_named_records(120000);
+    write_test_file("test_data/org_input.txt", named);
+    free(named);
+    run_ex1("test_data/org_input.txt", "test_data/org_clean.txt");
+    run_ex1_args("--binary test_data/org_input.txt test_data/org_clean.bin");
+    
+    size_t record_count = 0;
+    Org org = build_org_from_clean_file("test_data/org_clean.txt");
+    assert_test(org_matches_clean_text(&org, "test_data/org_clean.txt", &record_count),
+                "Large text clean file loads the expected tree");
+    free_org(&org);
+    assert_test(record_count >= 100000, "Large clean file holds at least 100000 records");
+    
+    org = build_org_from_clean_file("test_data/org_clean.bin");
+    assert_test(org_matches_clean_text(&org, "test_data/org_clean.txt", &record_count),
+                "Large binary clean file loads the expected tree");
+    free_org(&org);
+    
+    // Counters must not depend on how the input was parsed
+    printf("\n=== Metrics Tests ===\n");
+    
+    for (int i = 1; i <= 10; i++) {
+        char test_name[128];
+        char *content = generate_records(0, 400, (unsigned int)i, 1);
+        write_test_file("test_data/metrics_input.txt", content);
+        free(content);
+        
+        run_ex1_args("--metrics test_data/metrics_input.txt test_data/metrics_serial.txt");
+        run_ex1_args("--metrics --threads 16 test_data/metrics_input.txt test_data/metrics_threads.txt");
+        sprintf(test_name, "Metrics counters, serial vs --threads 16 (%d)", i);
+        assert_test(metrics_counters_match("test_data/metrics_serial.txt.metrics.json",
+                                           "test_data/metrics_threads.txt.metrics.json"), test_name);
+        
+        run_ex1_args("--metrics --fused test_data/metrics_input.txt test_data/metrics_fused.txt");
+        sprintf(test_name, "Metrics counters, serial vs --fused (%d)", i);
+        assert_test(metrics_counters_match("test_data/metrics_serial.txt.metrics.json",
+                                           "test_data/metrics_fused.txt.metrics.json"), test_name);
+    }
+    
+    // Modes that keep no metrics must refuse --metrics rather than ignore it
+    remove("test_data/metrics_rejected.txt");
+    remove("test_data/metrics_rejected.txt.metrics.json");
+    run_ex1_args("--metrics --incremental test_data/metrics_input.txt test_data/metrics_rejected.txt");
+    char *rejected = read_file("test_data/metrics_rejected.txt");
+    assert_test(rejected == NULL, "--metrics with --incremental is a usage error");
+    free(rejected);
+}
+
 int main() {
     printf("========================================\n");
     printf("EX1 COMPREHENSIVE TEST SUITE\n");
@@ -606,8 +1212,9 @@ int main() {
     printf("Generating test files...\n");
     generate_test_files();
     
-    printf("\nRunning 100 tests...\n");
+    printf("\nRunning tests...\n");
     run_tests();
+    run_mode_tests();
     
     printf("\n========================================\n");
     printf("TEST RESULTS\n");